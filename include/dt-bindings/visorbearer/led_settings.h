@@ -0,0 +1,25 @@
+#pragma once
+
+// Runtime LED bar settings, shared by keymaps and the firmware
+#define LED_SETTING_BRIGHTNESS 0         // cap on every segment, percent
+#define LED_SETTING_FADE_MS 1
+#define LED_SETTING_MODIFIER_FADE_MS 2
+#define LED_SETTING_BREATH_PERIOD_MS 3
+#define LED_SETTING_BREATH_MIN 4
+#define LED_SETTING_BREATH_MAX 5
+#define LED_SETTING_EVENT_DISPLAY_MS 6
+#define LED_SETTING_BATTERY_LOW 7
+#define LED_SETTING_BATTERY_CRITICAL 8
+#define LED_SETTINGS_COUNT 9
+
+// First parameter of &led_cfg: what to do with which setting. The second
+// parameter is the value for LED_SET and the step for LED_INC/LED_DEC.
+#define LED_SETTING_OP_SET 0
+#define LED_SETTING_OP_INC 1
+#define LED_SETTING_OP_DEC 2
+#define LED_SETTING_OP_RESET 3
+
+#define LED_SET(setting) ((LED_SETTING_OP_SET << 8) | (setting))
+#define LED_INC(setting) ((LED_SETTING_OP_INC << 8) | (setting))
+#define LED_DEC(setting) ((LED_SETTING_OP_DEC << 8) | (setting))
+#define LED_SETTINGS_RESET (LED_SETTING_OP_RESET << 8)
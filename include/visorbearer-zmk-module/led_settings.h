@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <dt-bindings/visorbearer/led_settings.h>
+
+#define LED_SETTING_OP(param) ((param) >> 8)
+#define LED_SETTING_ID(param) ((param) & 0xFF)
+
+// Setters clamp the value to the setting's range and return what is now in
+// effect, or -EINVAL for an unknown setting. Changes are saved once they
+// settle for CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE ms. While an input trace is
+// replayed they are saved and read back right away, but only show once it ends.
+int led_setting_get(uint8_t setting);
+int led_setting_set(uint8_t setting, int value);
+int led_setting_adjust(uint8_t setting, int delta);
+void led_settings_reset(void);
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""Generate the perceptual brightness table used by the LED bar renderer.
+
+Maps segment brightness 0-100 to the LP50xx LEDx_BRIGHTNESS duty 0-255 as
+duty = 255 * (level / 100) ^ gamma. Every level above zero stays lit.
+"""
+
+import argparse
+
+LEVELS = 100
+DUTY_MAX = 0xFF
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--gamma", type=int, required=True, help="gamma times 10")
+    parser.add_argument("output", help="header to write")
+    args = parser.parse_args()
+
+    gamma = args.gamma / 10
+    duty = [0] + [
+        max(1, round(DUTY_MAX * (level / LEVELS) ** gamma)) for level in range(1, LEVELS + 1)
+    ]
+
+    rows = [
+        "    " + ", ".join(f"{d:3d}" for d in duty[i : i + 12]) + ","
+        for i in range(0, len(duty), 12)
+    ]
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("// Generated by scripts/gen_gamma_table.py, do not edit\n\n")
+        f.write("#pragma once\n\n")
+        f.write("#include <stdint.h>\n\n")
+        f.write(f"// Perceptual brightness 0-{LEVELS} to LEDx_BRIGHTNESS duty, gamma {gamma:.1f}\n")
+        f.write(f"static const uint8_t led_gamma_table[{LEVELS + 1}] = {{\n")
+        f.write("\n".join(rows) + "\n")
+        f.write("};\n")
+
+
+if __name__ == "__main__":
+    main()
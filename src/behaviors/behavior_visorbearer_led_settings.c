@@ -0,0 +1,98 @@
+#define DT_DRV_COMPAT zmk_behavior_visorbearer_led_settings
+
+#include <zephyr/device.h>
+#include <drivers/behavior.h>
+#include <zephyr/logging/log.h>
+
+#include <zmk/behavior.h>
+#include "visorbearer-zmk-module/led_settings.h"
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#if IS_ENABLED(CONFIG_ZMK_BEHAVIOR_METADATA)
+static const struct behavior_parameter_value_metadata param1_values[] = {
+    {
+        .display_name = "Command",
+        .type = BEHAVIOR_PARAMETER_VALUE_TYPE_RANGE,
+        .range = {.min = 0, .max = LED_SETTINGS_RESET},
+    },
+};
+
+static const struct behavior_parameter_value_metadata param2_values[] = {
+    {
+        .display_name = "Value",
+        .type = BEHAVIOR_PARAMETER_VALUE_TYPE_RANGE,
+        .range = {.min = 0, .max = UINT16_MAX},
+    },
+};
+
+static const struct behavior_parameter_metadata_set param_metadata_set[] = {{
+    .param1_values = param1_values,
+    .param1_values_len = ARRAY_SIZE(param1_values),
+    .param2_values = param2_values,
+    .param2_values_len = ARRAY_SIZE(param2_values),
+}};
+
+static const struct behavior_parameter_metadata metadata = {
+    .sets_len = ARRAY_SIZE(param_metadata_set),
+    .sets = param_metadata_set,
+};
+#endif
+
+static int behavior_visorbearer_led_settings_init(const struct device *dev) {
+    return 0;
+}
+
+// Only posts the change to the LED renderer, saving to flash happens later
+static int on_keymap_binding_pressed(struct zmk_behavior_binding *binding,
+                                     struct zmk_behavior_binding_event event) {
+    uint8_t setting = LED_SETTING_ID(binding->param1);
+    int ret;
+
+    switch (LED_SETTING_OP(binding->param1)) {
+        case LED_SETTING_OP_SET:
+            ret = led_setting_set(setting, binding->param2);
+            break;
+        case LED_SETTING_OP_INC:
+            ret = led_setting_adjust(setting, binding->param2);
+            break;
+        case LED_SETTING_OP_DEC:
+            ret = led_setting_adjust(setting, -(int)binding->param2);
+            break;
+        case LED_SETTING_OP_RESET:
+            led_settings_reset();
+            ret = 0;
+            break;
+        default:
+            ret = -ENOTSUP;
+            break;
+    }
+
+    if (ret < 0) {
+        LOG_ERR("Unknown LED setting command 0x%x", binding->param1);
+        return ret;
+    }
+
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static int on_keymap_binding_released(struct zmk_behavior_binding *binding,
+                                      struct zmk_behavior_binding_event event) {
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static const struct behavior_driver_api behavior_visorbearer_led_settings_driver_api = {
+    .binding_pressed = on_keymap_binding_pressed,
+    .binding_released = on_keymap_binding_released,
+    .locality = BEHAVIOR_LOCALITY_GLOBAL,
+#if IS_ENABLED(CONFIG_ZMK_BEHAVIOR_METADATA)
+    .parameter_metadata = &metadata,
+#endif
+};
+
+#define LED_SETTINGS_INST(n)                                                                         \
+    BEHAVIOR_DT_INST_DEFINE(n, behavior_visorbearer_led_settings_init, NULL, NULL, NULL,            \
+                            POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,                        \
+                            &behavior_visorbearer_led_settings_driver_api);
+
+DT_INST_FOREACH_STATUS_OKAY(LED_SETTINGS_INST)
@@ -1,11 +1,19 @@
 #include <stdlib.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
-#include <zephyr/drivers/led.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/hwinfo.h>
 #include <zephyr/drivers/led/lp50xx.h>
 #include <zephyr/dt-bindings/led/led.h>
 #include <zephyr/kernel.h>
+#include <zephyr/pm/device.h>
+#ifdef CONFIG_VISORBEARER_LED_BAR_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+#if IS_ENABLED(CONFIG_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
 
 #include <zmk/ble.h>
 #include <zmk/events/ble_active_profile_changed.h>
@@ -19,38 +27,159 @@
 #include <zmk/events/usb_conn_state_changed.h>
 #include <zmk/hid.h>
 #include <zmk/endpoints.h>
+#ifdef CONFIG_VISORBEARER_LED_BAR_LAYER_INDICATOR
+#include <zmk/keymap.h>
+#include <zmk/events/layer_state_changed.h>
+#endif
+#ifdef CONFIG_VISORBEARER_LED_BAR_LOCK_INDICATOR
+#include <zmk/hid_indicators.h>
+#include <zmk/events/hid_indicators_changed.h>
+#endif
 
 #include "visorbearer-zmk-module/led_show.h"
+#include "visorbearer-zmk-module/led_settings.h"
+#include "led_gamma.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(led_bar, 4);
 
-#define LPA_NODE DT_NODELABEL(lp5012a)
-#define LPB_NODE DT_NODELABEL(lp5012b)
-#define NUM_SEGMENTS 4
+#define DT_DRV_COMPAT zmk_visorbearer_led_bar
+
+BUILD_ASSERT(DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) > 0,
+             "No zmk,visorbearer-led-bar nodes enabled in devicetree");
+
+// Segment brightness is perceptual, led_gamma_table maps it to PWM duty
 #define MAX_BRIGHTNESS 100
 
-#define LED_FADE_STEP_SIZE CONFIG_VISORBEARER_LED_BAR_FADE_STEP_SIZE
-#define LED_INIT_FADE_STEP_SIZE CONFIG_VISORBEARER_LED_BAR_INIT_FADE_STEP_SIZE
-#define LED_BREATH_STEP_SIZE CONFIG_VISORBEARER_LED_BAR_BREATH_STEP_SIZE
-#define LED_BREATH_MIN CONFIG_VISORBEARER_LED_BAR_BREATH_MIN
-#define LED_BREATH_MAX CONFIG_VISORBEARER_LED_BAR_BREATH_MAX
-#define MODIFIER_FADE_STEP_SIZE CONFIG_VISORBEARER_LED_BAR_MODIFIER_FADE_STEP_SIZE
+// LP50xx register image, written from LED_CONFIG0 up: the LEDx_BANK_EN bits (one
+// byte per 8 LEDs), BANK_BRIGHTNESS, BANK_A/B/C_COLOR, then LEDx_BRIGHTNESS for every
+// LED the model has and OUTx_COLOR (3 per LED). The registers are contiguous, so one
+// auto-increment burst covers any run of them. LP5009 keeps the LP5012 register map.
+#define LP5012_MAX_LEDS 4
+#define LP5024_MAX_LEDS 8
+#define LP5036_MAX_LEDS 12
+#define LP50XX_COLORS_PER_LED 3
+#define LP50XX_LED_CONFIG0 0x02
+#define LP50XX_BANK_REGS (1 + LP50XX_COLORS_PER_LED)
+#define LP50XX_CONFIG_CHANNELS(max_leds) DIV_ROUND_UP(max_leds, 8)
+#define LP50XX_CHANNELS(max_leds)                                              \
+    (LP50XX_CONFIG_CHANNELS(max_leds) + LP50XX_BANK_REGS + (max_leds) * (1 + LP50XX_COLORS_PER_LED))
+#define LP50XX_BANK_BRIGHTNESS_CHANNEL(chip) LP50XX_CONFIG_CHANNELS((chip)->max_leds)
+#define LP50XX_BANK_COLOR_CHANNEL(chip) (LP50XX_BANK_BRIGHTNESS_CHANNEL(chip) + 1)
+#define LP50XX_BRIGHTNESS_CHANNEL(chip, led)                                   \
+    (LP50XX_BANK_BRIGHTNESS_CHANNEL(chip) + LP50XX_BANK_REGS + (led))
+#define LP50XX_COLOR_CHANNEL(chip, led)                                        \
+    (LP50XX_BRIGHTNESS_CHANNEL(chip, (chip)->max_leds) + (led) * LP50XX_COLORS_PER_LED)
+
+// Register image size for the largest model in the devicetree
+#if DT_HAS_COMPAT_STATUS_OKAY(ti_lp5030) || DT_HAS_COMPAT_STATUS_OKAY(ti_lp5036)
+#define LP50XX_MAX_CHANNELS LP50XX_CHANNELS(LP5036_MAX_LEDS)
+#elif DT_HAS_COMPAT_STATUS_OKAY(ti_lp5018) || DT_HAS_COMPAT_STATUS_OKAY(ti_lp5024)
+#define LP50XX_MAX_CHANNELS LP50XX_CHANNELS(LP5024_MAX_LEDS)
+#else
+#define LP50XX_MAX_CHANNELS LP50XX_CHANNELS(LP5012_MAX_LEDS)
+#endif
+// Bytes an extra burst costs on the bus (address, register, start/stop); unchanged
+// runs shorter than this are cheaper to rewrite than to split the burst around
+#define LP50XX_BURST_OVERHEAD 3
+// Most bursts one flush can split into, given the overhead rule above and the
+// LED_CONFIG registers going out on their own
+#define LP50XX_MAX_BURSTS (LP50XX_MAX_CHANNELS / (LP50XX_BURST_OVERHEAD + 2) + 2)
+
+#define LP50XX_DEVICE_CONFIG0 0x00
+#define LP50XX_DEVICE_CONFIG1 0x01
+#define LP50XX_CHIP_EN BIT(6)
+#define LP50XX_LOG_SCALE_EN BIT(5)
+#define LP50XX_MAX_CURR_OPT BIT(1)
+#define LP50XX_ENABLE_DELAY_US 500
+// Longest a frame's async writes may take before the next flush gives up on them
+#define LED_FLUSH_TIMEOUT_MS 100
+// Full-scale output current without and with MAX_CURR_OPT
+#define LP50XX_MAX_CURRENT_UA 25500
+#define LP50XX_MAX_CURRENT_HIGH_UA 35000
+
+#define LED_CURRENT_BUDGET_MA CONFIG_VISORBEARER_LED_BAR_CURRENT_BUDGET_MA
+#define LED_CURRENT_BUDGET_MIN_PCT CONFIG_VISORBEARER_LED_BAR_CURRENT_BUDGET_MIN_PCT
+
+// Fade and breath timing, brightness cap, display time and battery thresholds
+// are runtime settings (led_settings.h), their Kconfig values are the defaults.
+// The deprecated step sizes were brightness per 10 ms frame, when set they still
+// decide the durations.
+#define LED_STEP_DURATION_MS(range, step) ((range) * 10 / (step))
+
+#if CONFIG_VISORBEARER_LED_BAR_FADE_STEP_SIZE > 0
+#warning "VISORBEARER_LED_BAR_FADE_STEP_SIZE is deprecated, use VISORBEARER_LED_BAR_FADE_DURATION_MS"
+#define LED_FADE_DURATION_MS                                                                  \
+    LED_STEP_DURATION_MS(MAX_BRIGHTNESS, CONFIG_VISORBEARER_LED_BAR_FADE_STEP_SIZE)
+#else
+#define LED_FADE_DURATION_MS CONFIG_VISORBEARER_LED_BAR_FADE_DURATION_MS
+#endif
+
+#if CONFIG_VISORBEARER_LED_BAR_INIT_FADE_STEP_SIZE > 0
+#warning "VISORBEARER_LED_BAR_INIT_FADE_STEP_SIZE is deprecated, use VISORBEARER_LED_BAR_INIT_FADE_DURATION_MS"
+#define LED_INIT_FADE_DURATION_MS                                                             \
+    LED_STEP_DURATION_MS(MAX_BRIGHTNESS, CONFIG_VISORBEARER_LED_BAR_INIT_FADE_STEP_SIZE)
+#else
+#define LED_INIT_FADE_DURATION_MS CONFIG_VISORBEARER_LED_BAR_INIT_FADE_DURATION_MS
+#endif
+
+#if CONFIG_VISORBEARER_LED_BAR_BREATH_STEP_SIZE > 0
+#warning "VISORBEARER_LED_BAR_BREATH_STEP_SIZE is deprecated, use VISORBEARER_LED_BAR_BREATH_PERIOD_MS"
+// down and back up, no shorter than the breath-period-ms setting allows
+#define LED_BREATH_PERIOD_MS                                                                  \
+    MAX(2 * LED_STEP_DURATION_MS(CONFIG_VISORBEARER_LED_BAR_BREATH_MAX -                      \
+                                     CONFIG_VISORBEARER_LED_BAR_BREATH_MIN,                   \
+                                 CONFIG_VISORBEARER_LED_BAR_BREATH_STEP_SIZE),                \
+        100)
+#else
+#define LED_BREATH_PERIOD_MS CONFIG_VISORBEARER_LED_BAR_BREATH_PERIOD_MS
+#endif
+
+#if CONFIG_VISORBEARER_LED_BAR_MODIFIER_FADE_STEP_SIZE > 0
+#warning "VISORBEARER_LED_BAR_MODIFIER_FADE_STEP_SIZE is deprecated, use VISORBEARER_LED_BAR_MODIFIER_FADE_DURATION_MS"
+#define LED_MODIFIER_FADE_DURATION_MS                                                         \
+    LED_STEP_DURATION_MS(MAX_BRIGHTNESS, CONFIG_VISORBEARER_LED_BAR_MODIFIER_FADE_STEP_SIZE)
+#else
+#define LED_MODIFIER_FADE_DURATION_MS CONFIG_VISORBEARER_LED_BAR_MODIFIER_FADE_DURATION_MS
+#endif
+BUILD_ASSERT(ARRAY_SIZE(led_gamma_table) == MAX_BRIGHTNESS + 1,
+             "Gamma table does not cover every brightness level");
+
+// Frame interval is picked per animation so each transition gets about
+// LED_ANIM_FRAMES frames, within what the LED thread and the eye can use
+#define LED_ANIM_FRAMES CONFIG_VISORBEARER_LED_BAR_FRAMES_PER_TRANSITION
+#define LED_FRAME_MIN_MS 10
+#define LED_FRAME_MAX_MS 50
+#define LED_COALESCE_MS CONFIG_VISORBEARER_LED_BAR_COALESCE_MS
+
+#define Q16_ONE (1 << 16)
 
 #define LED_STARTUP_DISPLAY_TIME_MS CONFIG_VISORBEARER_LED_BAR_STARTUP_DISPLAY_TIME_MS
-#define LED_EVENT_DISPLAY_TIME_MS CONFIG_VISORBEARER_LED_BAR_EVENT_DISPLAY_TIME_MS
 #define LED_INIT_PAUSE_TIME_MS CONFIG_VISORBEARER_LED_BAR_INIT_PAUSE_TIME_MS
 
-#define BATTERY_CRITICAL_THRESHOLD CONFIG_VISORBEARER_LED_BAR_BATTERY_CRITICAL_THRESHOLD
-#define BATTERY_LOW_THRESHOLD CONFIG_VISORBEARER_LED_BAR_BATTERY_LOW_THRESHOLD
-#define BATTERY_PER_SEGMENT 25
-#define CHARGING_CHECK_THROTTLE_MS 1000
+#define BATTERY_HYSTERESIS CONFIG_VISORBEARER_LED_BAR_BATTERY_HYSTERESIS
+// XIAO BLE charger status output, low while charging
+#define CHARGE_STATUS_PIN 17
+#define CHARGE_DEBOUNCE_MS CONFIG_VISORBEARER_LED_BAR_CHARGE_DEBOUNCE_MS
+#define LED_IDLE_HEARTBEAT_MS CONFIG_VISORBEARER_LED_BAR_IDLE_HEARTBEAT_MS
+// A heartbeat fades in, then starts fading out
+#define LED_HEARTBEAT_ON_MS (2 * fade_timing.duration_ms)
+// How long sleep waits for the renderer to darken the bars
+#define LED_PARK_TIMEOUT_MS 50
+// Clock the frame cost counters are kept in, host tests swap in their CPU time
+#ifndef LED_FRAME_CYCLES
+#define LED_FRAME_CYCLES() k_cycle_get_32()
+#endif
 
 #define MOD_SEGMENT_SHIFT 0
 #define MOD_SEGMENT_CTRL  1
 #define MOD_SEGMENT_ALT   2
 #define MOD_SEGMENT_GUI   3
 
+// Host lock LEDs, in the bit order of the HID keyboard output report
+#define LOCK_NUM  BIT(0)
+#define LOCK_CAPS BIT(1)
+
 enum color_index {
     COLOR_OFF,
     COLOR_PROFILE_CONNECTED,
@@ -62,7 +191,9 @@ enum color_index {
     COLOR_BATTERY_YELLOW,
     COLOR_BATTERY_RED,
     COLOR_CHARGING_GREEN,
-    COLOR_MODIFIER_ACTIVE
+    COLOR_MODIFIER_ACTIVE,
+    COLOR_LAYER_ACTIVE,
+    COLOR_LOCK_ACTIVE
 #ifdef CONFIG_VISORBEARER_LED_BAR_BATTERY_GRANULAR
     ,
     COLOR_BATTERY_WHITE_MID,
@@ -81,7 +212,9 @@ static const uint8_t colors[][3] = {
     [COLOR_BATTERY_YELLOW] = {0xB3, 0xB3, 0x00},
     [COLOR_BATTERY_RED] = {0xB3, 0x00, 0x00},
     [COLOR_CHARGING_GREEN] = {0x00, 0xB3, 0x00},
-    [COLOR_MODIFIER_ACTIVE] = {0x1A, 0x1A, 0x1A}
+    [COLOR_MODIFIER_ACTIVE] = {0x1A, 0x1A, 0x1A},
+    [COLOR_LAYER_ACTIVE] = {0x00, 0x33, 0x33},
+    [COLOR_LOCK_ACTIVE] = {0x33, 0x1A, 0x00}
 #ifdef CONFIG_VISORBEARER_LED_BAR_BATTERY_GRANULAR
     ,
     [COLOR_BATTERY_WHITE_MID] = {0x4D, 0x4D, 0x4D},
@@ -92,23 +225,276 @@ static const uint8_t colors[][3] = {
 enum animation_type {
     ANIM_NONE,
     ANIM_FADE,
-    ANIM_BREATH
+    ANIM_BREATH,
+    ANIM_PATTERN
+};
+#define NUM_ANIMATION_TYPES (ANIM_PATTERN + 1)
+
+enum easing {
+    EASE_LINEAR,
+    EASE_IN_OUT
+};
+
+// Same order as the use enum in zmk,visorbearer-led-patterns.yaml
+enum led_pattern_use {
+    PATTERN_ADVERTISING,
+    PATTERN_DISCONNECTED,
+    PATTERN_CRITICAL_BATTERY,
+    PATTERN_CHARGING,
+};
+
+// Where a keyframe's color or brightness comes from, so one table serves every
+// color and level a segment is asked for
+enum keyframe_ref {
+    KEYFRAME_OWN,           // the keyframe's own value
+    KEYFRAME_FROM,          // where the segment was when the pattern started
+    KEYFRAME_TARGET,        // what the layers asked the segment to show
+    KEYFRAME_BREATH_MIN,    // brightness only, the breathing range from the settings
+    KEYFRAME_BREATH_MAX,
+};
+
+struct led_keyframe {
+    uint16_t time;          // from the start of the pattern, in pattern units
+    uint8_t color[3];
+    uint8_t brightness;
+    uint8_t easing;         // enum easing of the transition into this keyframe
+    uint8_t color_ref;      // enum keyframe_ref
+    uint8_t brightness_ref;
+};
+
+// Keyframe effect in flash. Every animation a segment runs is one of these, played by
+// segment_update().
+struct led_pattern {
+    const struct led_keyframe *frames;
+    uint8_t num_frames;
+    uint8_t use;            // devicetree patterns only
+    bool loop;
+    uint16_t segment_delay_ms;  // each further segment of a bar starts this much later
+};
+
+// A pattern's LED_PATTERN_SPAN units take the duration it is started with. The built-in
+// ones span exactly that and get their duration from the settings, devicetree ones play
+// with a duration of LED_PATTERN_SPAN ms so their times stay in ms.
+#define LED_PATTERN_SPAN 1024
+
+// From wherever the segment is to its target
+static const struct led_keyframe fade_keyframes[] = {
+    {.time = 0, .color_ref = KEYFRAME_FROM, .brightness_ref = KEYFRAME_FROM},
+    {.time = LED_PATTERN_SPAN, .easing = EASE_IN_OUT,
+     .color_ref = KEYFRAME_TARGET, .brightness_ref = KEYFRAME_TARGET},
+};
+
+static const struct led_keyframe linear_fade_keyframes[] = {
+    {.time = 0, .color_ref = KEYFRAME_FROM, .brightness_ref = KEYFRAME_FROM},
+    {.time = LED_PATTERN_SPAN, .easing = EASE_LINEAR,
+     .color_ref = KEYFRAME_TARGET, .brightness_ref = KEYFRAME_TARGET},
+};
+
+// Target color, max -> min over the first half period, back to max over the second
+static const struct led_keyframe breath_keyframes[] = {
+    {.time = 0, .color_ref = KEYFRAME_TARGET, .brightness_ref = KEYFRAME_BREATH_MAX},
+    {.time = LED_PATTERN_SPAN / 2, .easing = EASE_IN_OUT,
+     .color_ref = KEYFRAME_TARGET, .brightness_ref = KEYFRAME_BREATH_MIN},
+    {.time = LED_PATTERN_SPAN, .easing = EASE_IN_OUT,
+     .color_ref = KEYFRAME_TARGET, .brightness_ref = KEYFRAME_BREATH_MAX},
+};
+
+static const struct led_pattern fade_pattern = {
+    .frames = fade_keyframes,
+    .num_frames = ARRAY_SIZE(fade_keyframes),
+};
+static const struct led_pattern linear_fade_pattern = {
+    .frames = linear_fade_keyframes,
+    .num_frames = ARRAY_SIZE(linear_fade_keyframes),
+};
+static const struct led_pattern breath_pattern = {
+    .frames = breath_keyframes,
+    .num_frames = ARRAY_SIZE(breath_keyframes),
+    .loop = true,
+};
+
+struct anim_timing {
+    uint16_t duration_ms;   // full-scale fade time
+    const struct led_pattern *fade;
 };
 
+// durations of fade_timing and modifier_fade_timing follow the runtime settings
+static struct anim_timing fade_timing = {LED_FADE_DURATION_MS, &fade_pattern};
+static const struct anim_timing init_fade_timing = {LED_INIT_FADE_DURATION_MS, &fade_pattern};
+static struct anim_timing modifier_fade_timing = {LED_MODIFIER_FADE_DURATION_MS,
+                                                  &linear_fade_pattern};
+
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_visorbearer_led_patterns)
+#define LED_KEYFRAME(node)                                                      \
+    {                                                                           \
+        .time = DT_PROP(node, time_ms),                                         \
+        .color = {(DT_PROP(node, color) >> 16) & 0xFF,                          \
+                  (DT_PROP(node, color) >> 8) & 0xFF, DT_PROP(node, color) & 0xFF}, \
+        .brightness = MIN(DT_PROP(node, brightness), MAX_BRIGHTNESS),           \
+        .easing = DT_ENUM_IDX(node, easing),                                    \
+    },
+
+// Keyframe times must not decrease, the interpreter subtracts each from the next.
+// Checked pairwise over up to LED_PATTERN_MAX_KEYFRAMES times, the padding after
+// the last one is above any uint16_t time.
+#define LED_PATTERN_MAX_KEYFRAMES 16
+#define LED_KEYFRAME_TIME(node) DT_PROP(node, time_ms)
+#define LED_TIMES_SORTED(...)                                                   \
+    LED_TIMES_SORTED_(__VA_ARGS__, 0x10000, 0x10001, 0x10002, 0x10003, 0x10004, \
+                      0x10005, 0x10006, 0x10007, 0x10008, 0x10009, 0x1000A,     \
+                      0x1000B, 0x1000C, 0x1000D, 0x1000E, 0x1000F)
+#define LED_TIMES_SORTED_(t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12,  \
+                          t13, t14, t15, ...)                                   \
+    ((t0) <= (t1) && (t1) <= (t2) && (t2) <= (t3) && (t3) <= (t4) &&            \
+     (t4) <= (t5) && (t5) <= (t6) && (t6) <= (t7) && (t7) <= (t8) &&            \
+     (t8) <= (t9) && (t9) <= (t10) && (t10) <= (t11) && (t11) <= (t12) &&       \
+     (t12) <= (t13) && (t13) <= (t14) && (t14) <= (t15))
+
+#define LED_PATTERN_KEYFRAMES(node)                                             \
+    static const struct led_keyframe DT_CAT(node, _keyframes)[] = {             \
+        DT_FOREACH_CHILD(node, LED_KEYFRAME)};                                  \
+    BUILD_ASSERT(ARRAY_SIZE(DT_CAT(node, _keyframes)) > 0 &&                    \
+                     ARRAY_SIZE(DT_CAT(node, _keyframes)) <= LED_PATTERN_MAX_KEYFRAMES, \
+                 DT_NODE_FULL_NAME(node) " needs 1 to 16 keyframes");           \
+    BUILD_ASSERT(LED_TIMES_SORTED(DT_FOREACH_CHILD_SEP(node, LED_KEYFRAME_TIME, (,))), \
+                 DT_NODE_FULL_NAME(node) " keyframe time-ms values must not decrease");
+#define LED_PATTERNS_KEYFRAMES(node) DT_FOREACH_CHILD_STATUS_OKAY(node, LED_PATTERN_KEYFRAMES)
+
+DT_FOREACH_STATUS_OKAY(zmk_visorbearer_led_patterns, LED_PATTERNS_KEYFRAMES)
+
+#define LED_PATTERN(node)                                                       \
+    {                                                                           \
+        .frames = DT_CAT(node, _keyframes),                                     \
+        .num_frames = ARRAY_SIZE(DT_CAT(node, _keyframes)),                     \
+        .use = DT_ENUM_IDX(node, use),                                          \
+        .loop = DT_PROP(node, loop),                                            \
+        .segment_delay_ms = DT_PROP(node, segment_delay_ms),                    \
+    },
+#define LED_PATTERNS(node) DT_FOREACH_CHILD_STATUS_OKAY(node, LED_PATTERN)
+
+static const struct led_pattern patterns[] = {
+    DT_FOREACH_STATUS_OKAY(zmk_visorbearer_led_patterns, LED_PATTERNS)
+};
+#endif
+
+// The pattern replacing the built-in animation for use, NULL to keep the built-in one
+static const struct led_pattern *led_pattern_for(enum led_pattern_use use) {
+#if DT_HAS_COMPAT_STATUS_OKAY(zmk_visorbearer_led_patterns)
+    for (size_t i = 0; i < ARRAY_SIZE(patterns); i++) {
+        if (patterns[i].use == use) {
+            return &patterns[i];
+        }
+    }
+#endif
+    return NULL;
+}
+
 struct led_segment {
     uint8_t color[3];
     uint8_t brightness;
+    uint8_t from_color[3];      // where the pattern found the segment
+    uint8_t from_brightness;
+    uint8_t target_color[3];    // what the layers last asked for
     uint8_t target_brightness;
-    enum animation_type animation;
-    int8_t fade_step;
-    bool breath_ascending;
+    // pattern being played, NULL after a cut. Kept with the cursor past its last
+    // keyframe once a one-shot pattern ends, so it isn't restarted.
+    const struct led_pattern *pattern;
+    int64_t start_time;
+    uint16_t duration_ms;       // what LED_PATTERN_SPAN pattern units take
+    uint8_t cursor;             // keyframe the pattern is heading for
     bool dirty;
 };
 
-struct led_bar {
-    struct led_segment segments[NUM_SEGMENTS];
+// Same order as the role enum in zmk,visorbearer-led-bar.yaml
+enum led_bar_role {
+    BAR_ROLE_CONNECTION,
+    BAR_ROLE_BATTERY,
+    NUM_BAR_ROLES,
+};
+
+// Display state shared by every bar with the same role
+struct led_bar_role_state {
     int64_t expire_time;
-    bool showing_modifiers;   // Only used for conn_bar
+    int64_t boot_until;       // boot animation owns the bars until then
+};
+
+struct led_bar {
+    const struct device *dev;
+    struct led_chip *chip;    // resolved from dev at init
+    const uint8_t *leds;      // controller LED index of each segment
+    struct led_segment *segments;
+    // what each segment shows for the filtered battery level, battery bars only
+    struct battery_segment_config *battery;
+    uint8_t num_segments;
+    enum led_bar_role role;
+};
+
+// What a layer asks one segment to show. Unset pixels let lower layers through.
+struct led_pixel {
+    uint8_t color[3];
+    uint8_t brightness;
+    enum animation_type animation;
+    const struct anim_timing *timing;
+    const struct led_pattern *pattern;  // ANIM_PATTERN only
+    uint16_t phase_ms;                  // pattern start delay of this segment
+    bool set;
+};
+
+// Layers render into their own pixels and are blended bottom to top per bar
+enum led_layer_id {
+#ifndef CONFIG_VISORBEARER_LED_BAR_MODIFIERS_OVER_INDICATORS
+    LAYER_MODIFIERS,
+#endif
+#ifdef CONFIG_VISORBEARER_LED_BAR_LAYER_INDICATOR
+    LAYER_KEYMAP,
+#endif
+#ifdef CONFIG_VISORBEARER_LED_BAR_LOCK_INDICATOR
+    LAYER_LOCKS,
+#endif
+#ifdef CONFIG_VISORBEARER_LED_BAR_MODIFIERS_OVER_INDICATORS
+    LAYER_MODIFIERS,
+#endif
+    LAYER_CONNECTION,
+    LAYER_BATTERY,
+    LAYER_HEARTBEAT,
+    LAYER_BOOT_CONNECTION,
+    LAYER_BOOT_BATTERY,
+};
+
+struct led_layer {
+    enum led_bar_role role;
+    uint8_t opacity;
+    // fills one pixel per segment of bar, returns false while the layer has nothing to show
+    bool (*render)(const struct led_bar *bar, struct led_pixel *pixels);
+};
+
+struct led_chip {
+    const struct device *dev;
+    struct i2c_dt_spec bus;
+    struct gpio_dt_spec enable;
+    uint8_t max_leds;  // LEDs the model has, sets the register layout
+    uint8_t config1;   // DEVICE_CONFIG1 bits from devicetree, lost when EN drops
+    bool used;         // drives at least one bar
+    bool powered;
+    // Last values written to the register image
+    uint8_t shadow[LP50XX_MAX_CHANNELS];
+    bool shadow_valid;
+    uint32_t bursts_written;
+    uint32_t bursts_skipped;
+    uint32_t bytes_written;
+    uint32_t bytes_skipped;
+    uint32_t write_errors;
+    uint32_t bank_frames;   // frames written with LEDs in bank mode
+    int64_t powered_since;
+    int64_t powered_ms;     // powered time before powered_since
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+    bool resync;            // an async write failed, rewrite the whole image
+    // this frame's bursts, each a register address followed by its channels
+    uint8_t tx[LP50XX_MAX_CHANNELS + LP50XX_MAX_BURSTS];
+    size_t tx_len;
+    struct i2c_msg msgs[LP50XX_MAX_BURSTS];
+    uint8_t num_msgs;
+#endif
 };
 
 struct battery_segment_config {
@@ -117,420 +503,2048 @@ struct battery_segment_config {
 };
 
 // Global state
-static struct led_bar conn_bar;
-static struct led_bar batt_bar;
-static const struct device *led_conn_dev;
-static const struct device *led_batt_dev;
+#define LED_CHIP_INIT(node, leds)                                              \
+    {                                                                          \
+        .dev = DEVICE_DT_GET(node),                                            \
+        .bus = I2C_DT_SPEC_GET(node),                                          \
+        .enable = GPIO_DT_SPEC_GET_OR(node, enable_gpios, {0}),                \
+        .max_leds = leds,                                                      \
+        .config1 = (DT_PROP(node, log_scale_en) ? LP50XX_LOG_SCALE_EN : 0) |   \
+                   (DT_PROP(node, max_curr_opt) ? LP50XX_MAX_CURR_OPT : 0),    \
+        .powered = true,                                                       \
+    },
+
+static struct led_chip chips[] = {
+    DT_FOREACH_STATUS_OKAY_VARGS(ti_lp5009, LED_CHIP_INIT, LP5012_MAX_LEDS)
+    DT_FOREACH_STATUS_OKAY_VARGS(ti_lp5012, LED_CHIP_INIT, LP5012_MAX_LEDS)
+    DT_FOREACH_STATUS_OKAY_VARGS(ti_lp5018, LED_CHIP_INIT, LP5024_MAX_LEDS)
+    DT_FOREACH_STATUS_OKAY_VARGS(ti_lp5024, LED_CHIP_INIT, LP5024_MAX_LEDS)
+    DT_FOREACH_STATUS_OKAY_VARGS(ti_lp5030, LED_CHIP_INIT, LP5036_MAX_LEDS)
+    DT_FOREACH_STATUS_OKAY_VARGS(ti_lp5036, LED_CHIP_INIT, LP5036_MAX_LEDS)
+};
+
+// Each bar gets its own segment array, sized by its leds property
+#define LED_BAR_STORAGE(n)                                                     \
+    static const uint8_t led_bar_leds_##n[] = DT_INST_PROP(n, leds);           \
+    static struct led_segment led_bar_segments_##n[DT_INST_PROP_LEN(n, leds)]; \
+    static struct battery_segment_config led_bar_battery_##n[DT_INST_PROP_LEN(n, leds)];
+
+#define LED_BAR_INIT(n)                                                        \
+    {                                                                          \
+        .dev = DEVICE_DT_GET(DT_INST_PHANDLE(n, led_controller)),              \
+        .leds = led_bar_leds_##n,                                              \
+        .segments = led_bar_segments_##n,                                      \
+        .battery = led_bar_battery_##n,                                        \
+        .num_segments = DT_INST_PROP_LEN(n, leds),                             \
+        .role = DT_INST_ENUM_IDX(n, role),                                     \
+    },
+
+DT_INST_FOREACH_STATUS_OKAY(LED_BAR_STORAGE)
+
+static struct led_bar bars[] = {DT_INST_FOREACH_STATUS_OKAY(LED_BAR_INIT)};
+
+// Longest bar, sizes the per-frame pixel buffers
+#define LED_BAR_SIZE(n) uint8_t bar_##n[DT_INST_PROP_LEN(n, leds)];
+union led_bar_sizes {
+    DT_INST_FOREACH_STATUS_OKAY(LED_BAR_SIZE)
+};
+#define LED_BAR_MAX_SEGMENTS sizeof(union led_bar_sizes)
+
+static struct led_bar_role_state role_state[NUM_BAR_ROLES];
 static const struct device *gpio0_dev;
 
 static struct {
     uint8_t active_profile;
     bool connected;
     bool advertising;
-    uint8_t battery_percentage;
+    uint8_t battery_raw;         // last reading
+    uint8_t battery_percentage;  // filtered, what the bars show
+    bool battery_valid;          // a reading came in since boot
     bool charging;
     bool actively_charging;
-    int64_t last_charging_check;
-    bool modifiers[NUM_SEGMENTS];  // [shift, ctrl, alt, gui]
+    uint8_t modifiers;  // BIT(MOD_SEGMENT_*)
+    uint8_t keymap_layer;  // highest active layer, 0 while only the default one is
+    uint8_t locks;      // LOCK_NUM/LOCK_CAPS
+    enum zmk_activity_state activity;
+    int64_t idle_since;
 } system_state;
 
-K_SEM_DEFINE(led_update_sem, 0, 1);
-
-static void segment_set(struct led_segment *seg, enum color_index color,
-                       uint8_t target, enum animation_type anim, int8_t fade_step) {
-    // Only update if something actually changes
-    if (memcmp(seg->color, colors[color], 3) == 0 &&
-        seg->target_brightness == target &&
-        seg->animation == anim) {
-        return;
-    }
+// Uptime the current frame is rendered for, shared by every segment in it
+static int64_t frame_time;
+static int64_t boot_start;
+static bool first_status_shown;
 
-    memcpy(seg->color, colors[color], 3);
-    seg->target_brightness = target;
-    seg->animation = anim;
-    seg->fade_step = fade_step;
-    seg->dirty = true;
+#ifdef CONFIG_VISORBEARER_LED_BAR_RENDERER_WORKQUEUE
+static void render_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(render_work, render_work_handler);
+#else
+K_SEM_DEFINE(led_update_sem, 0, 1);
+#endif
 
-    if (anim == ANIM_BREATH) {
-        if (seg->brightness > LED_BREATH_MAX) {
-            seg->brightness = LED_BREATH_MAX;
-            seg->breath_ascending = false;
-        } else if (seg->brightness < LED_BREATH_MIN) {
-            seg->brightness = LED_BREATH_MIN;
-            seg->breath_ascending = true;
-        }
+// Have the renderer run a frame as soon as frame pacing allows, or once the
+// coalescing window has collected whatever else arrives with this input
+static void renderer_wake(bool urgent) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_RENDERER_WORKQUEUE
+    if (urgent || LED_COALESCE_MS == 0) {
+        k_work_reschedule(&render_work, K_NO_WAIT);
+    } else if (!k_work_delayable_is_pending(&render_work) ||
+               k_work_delayable_remaining_get(&render_work) > k_ms_to_ticks_ceil32(LED_COALESCE_MS)) {
+        // pull a later deadline in, but never push back an earlier wakeup
+        k_work_reschedule(&render_work, K_MSEC(LED_COALESCE_MS));
     }
+#else
+    // the thread holds the coalescing window itself
+    ARG_UNUSED(urgent);
+    k_sem_give(&led_update_sem);
+#endif
 }
 
-static void segment_update(struct led_segment *seg) {
-    switch (seg->animation) {
-        case ANIM_NONE:
-            if (seg->brightness != seg->target_brightness) {
-                seg->brightness = seg->target_brightness;
-                seg->dirty = true;
-            }
-            break;
-
-        case ANIM_FADE:
-            if (seg->brightness != seg->target_brightness) {
-                int16_t diff = seg->target_brightness - seg->brightness;
-                int16_t step = abs(seg->fade_step);
-                if (abs(diff) <= step) {
-                    seg->brightness = seg->target_brightness;
-                    seg->animation = ANIM_NONE;
-                } else {
-                    seg->brightness += (diff > 0) ? step : -step;
-                }
-                seg->dirty = true;
-            } else {
-                seg->animation = ANIM_NONE;
-            }
-            break;
-
-        case ANIM_BREATH:
-            seg->brightness += seg->breath_ascending ? LED_BREATH_STEP_SIZE : -LED_BREATH_STEP_SIZE;
-            if (seg->brightness >= LED_BREATH_MAX) {
-                seg->brightness = LED_BREATH_MAX;
-                seg->breath_ascending = false;
-            } else if (seg->brightness <= LED_BREATH_MIN) {
-                seg->brightness = LED_BREATH_MIN;
-                seg->breath_ascending = true;
-            }
-            seg->dirty = true;
-            break;
-    }
-}
+// Inputs handed from event listeners to the renderer. Listeners store a
+// snapshot and flag it, the renderer applies everything pending once per frame.
+// system_state and the bars are only ever touched by the renderer.
+enum led_input {
+    LED_INPUT_BLE,
+    LED_INPUT_POWER,
+    LED_INPUT_BATTERY,
+    LED_INPUT_MODIFIERS,
+    LED_INPUT_SHOW_CONNECTION,
+    LED_INPUT_SHOW_BATTERY,
+    LED_INPUT_RESET_STATS,
+    LED_INPUT_ACTIVITY,
+    LED_INPUT_SETTINGS,
+    LED_INPUT_KEYMAP_LAYER,
+    LED_INPUT_LOCKS,
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+    LED_INPUT_TRACE_ORIGIN,  // start over from the trace origin
+#endif
+    NUM_LED_INPUTS,
+};
 
-static void segment_write_hardware(const struct device *dev, int index, struct led_segment *seg) {
-    if (!seg->dirty) return;
+// Inputs that skip the coalescing window: held modifiers, layers and locks
+// should track the keys, and sleep has to park the bars before ZMK suspends devices
+#define LED_URGENT_INPUTS (BIT(LED_INPUT_MODIFIERS) | BIT(LED_INPUT_KEYMAP_LAYER) |              \
+                           BIT(LED_INPUT_LOCKS) | BIT(LED_INPUT_ACTIVITY))
 
-    if (seg->brightness == 0) {
-        led_off(dev, index);
-    } else {
-        led_set_color(dev, index, 3, seg->color);
-        led_on(dev, index);
-        led_set_brightness(dev, index, seg->brightness);
-    }
-    seg->dirty = false;
-}
+#define BLE_SNAPSHOT_PROFILE_MASK 0xFF
+#define BLE_SNAPSHOT_CONNECTED BIT(8)
+#define BLE_SNAPSHOT_ADVERTISING BIT(9)
+#define POWER_SNAPSHOT_USB 0
+#define POWER_SNAPSHOT_CHARGING 1
 
-static bool any_modifier_active(void) {
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        if (system_state.modifiers[i]) return true;
+// Renderer counters, only written by the renderer
+static struct {
+    uint32_t frames;
+    uint32_t anim_frames[NUM_ANIMATION_TYPES];  // frames with a segment in each, ANIM_NONE when all static
+    uint32_t event_wakeups;
+    uint32_t timeout_wakeups;
+    uint64_t update_cycles;
+    uint32_t update_cycles_max;
+    uint32_t current_ua;      // modeled LED current of the last frame
+    int64_t current_since;
+    uint64_t charge_ua_ms;    // modeled LED charge drawn before current_since
+} led_stats;
+
+static atomic_t pending_inputs;
+static atomic_t ble_snapshot;
+static atomic_t power_snapshot;
+static atomic_t battery_snapshot;
+static atomic_t modifier_snapshot;
+static atomic_t activity_snapshot;
+static atomic_t keymap_layer_snapshot;
+static atomic_t lock_snapshot;
+
+// Kconfig defaults of the runtime settings. They are in place from the start, so
+// stored settings loaded at any point of the boot are never overwritten.
+#define LED_SETTINGS_DEFAULTS                                                                \
+    {                                                                                        \
+        [LED_SETTING_BRIGHTNESS] = CONFIG_VISORBEARER_LED_BAR_BRIGHTNESS,                    \
+        [LED_SETTING_FADE_MS] = LED_FADE_DURATION_MS,                                        \
+        [LED_SETTING_MODIFIER_FADE_MS] = LED_MODIFIER_FADE_DURATION_MS,                      \
+        [LED_SETTING_BREATH_PERIOD_MS] = LED_BREATH_PERIOD_MS,                               \
+        [LED_SETTING_BREATH_MIN] = CONFIG_VISORBEARER_LED_BAR_BREATH_MIN,                    \
+        [LED_SETTING_BREATH_MAX] = CONFIG_VISORBEARER_LED_BAR_BREATH_MAX,                    \
+        [LED_SETTING_EVENT_DISPLAY_MS] = CONFIG_VISORBEARER_LED_BAR_EVENT_DISPLAY_TIME_MS,   \
+        [LED_SETTING_BATTERY_LOW] = CONFIG_VISORBEARER_LED_BAR_BATTERY_LOW_THRESHOLD,        \
+        [LED_SETTING_BATTERY_CRITICAL] = CONFIG_VISORBEARER_LED_BAR_BATTERY_CRITICAL_THRESHOLD, \
     }
-    return false;
-}
 
-static bool is_actively_charging(void) {
-    if (!gpio0_dev) return false;
+static atomic_t settings_snapshot[LED_SETTINGS_COUNT] = LED_SETTINGS_DEFAULTS;
+static const uint16_t setting_defaults[LED_SETTINGS_COUNT] = LED_SETTINGS_DEFAULTS;
 
-    // Configure as input only when reading to minimize leakage current
-    gpio_pin_configure(gpio0_dev, 17, GPIO_INPUT);
+// The renderer's copy of settings_snapshot, taken when it applies LED_INPUT_SETTINGS
+static uint16_t led_settings[LED_SETTINGS_COUNT] = LED_SETTINGS_DEFAULTS;
 
-    k_usleep(10);
-
-    int pin_value = gpio_pin_get(gpio0_dev, 17);
-    bool charging = (pin_value == 0);
+// Allowed range of each setting, the Kconfig ranges of the defaults match
+struct led_setting_info {
+    const char *name;
+    uint16_t min;
+    uint16_t max;
+};
 
-    // If gpio_pin_get fails (returns negative), treat as not charging
-    if (pin_value < 0) {
-        charging = false;
-    }
+static const struct led_setting_info setting_info[LED_SETTINGS_COUNT] = {
+    [LED_SETTING_BRIGHTNESS] = {"brightness", 1, MAX_BRIGHTNESS},
+    [LED_SETTING_FADE_MS] = {"fade-ms", 10, 2000},
+    [LED_SETTING_MODIFIER_FADE_MS] = {"modifier-fade-ms", 10, 1000},
+    [LED_SETTING_BREATH_PERIOD_MS] = {"breath-period-ms", 100, 10000},
+    [LED_SETTING_BREATH_MIN] = {"breath-min", 0, 50},
+    [LED_SETTING_BREATH_MAX] = {"breath-max", 50, 100},
+    [LED_SETTING_EVENT_DISPLAY_MS] = {"event-display-ms", 500, 60000},
+    [LED_SETTING_BATTERY_LOW] = {"battery-low", 10, 30},
+    [LED_SETTING_BATTERY_CRITICAL] = {"battery-critical", 1, 20},
+};
 
-    gpio_pin_configure(gpio0_dev, 17, GPIO_DISCONNECTED);
+// Given by the renderer once a frame has parked the LEDs for sleep
+static K_SEM_DEFINE(led_parked_sem, 0, 1);
 
-    return charging;
-}
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+// Ring buffer of every input posted to the renderer, with the snapshot it carried
+#define LED_TRACE_ENTRIES CONFIG_VISORBEARER_LED_BAR_TRACE_ENTRIES
+#define LED_TRACE_SETTING 0xFE      // runtime setting changed, arg is the setting
+#define LED_TRACE_CHARGE_READ 0xFF  // raw charge status pin read, not an input
 
-static struct battery_segment_config get_battery_segment_config(int segment,
-                                                                uint8_t battery_pct,
-                                                                bool charging,
-                                                                bool actively_charging) {
-    bool is_critical = battery_pct < BATTERY_CRITICAL_THRESHOLD && !charging;
+struct led_trace_entry {
+    uint32_t time_ms;
+    uint16_t value;
+    uint8_t event;    // enum led_input, LED_TRACE_SETTING or LED_TRACE_CHARGE_READ
+    uint8_t arg;
+};
 
-    struct battery_segment_config config = {
-        .color = is_critical ? COLOR_BACKGROUND_RED : COLOR_BACKGROUND,
-        .animation = ANIM_FADE
-    };
+// Inputs that carry a snapshot, the rest are plain requests
+static atomic_t *const input_snapshots[NUM_LED_INPUTS] = {
+    [LED_INPUT_BLE] = &ble_snapshot,
+    [LED_INPUT_POWER] = &power_snapshot,
+    [LED_INPUT_BATTERY] = &battery_snapshot,
+    [LED_INPUT_MODIFIERS] = &modifier_snapshot,
+    [LED_INPUT_ACTIVITY] = &activity_snapshot,
+    [LED_INPUT_KEYMAP_LAYER] = &keymap_layer_snapshot,
+    [LED_INPUT_LOCKS] = &lock_snapshot,
+};
 
-    uint8_t filled_segments = battery_pct / BATTERY_PER_SEGMENT;
+// What the renderer is given again when a trace starts: every snapshot, the
+// settings, and the origin itself to cut the bars to a known dark state
+#define LED_TRACE_ORIGIN_INPUTS                                                              \
+    (BIT(LED_INPUT_TRACE_ORIGIN) | BIT(LED_INPUT_BLE) | BIT(LED_INPUT_POWER) |               \
+     BIT(LED_INPUT_BATTERY) | BIT(LED_INPUT_MODIFIERS) | BIT(LED_INPUT_ACTIVITY) |           \
+     BIT(LED_INPUT_KEYMAP_LAYER) | BIT(LED_INPUT_LOCKS) | BIT(LED_INPUT_SETTINGS))
+
+static struct led_trace_entry trace_entries[LED_TRACE_ENTRIES];
+static size_t trace_head;     // next slot to write
+static size_t trace_count;
+static bool trace_replaying;  // recording pauses while a trace is replayed
+// Settings put back when the replay ends, changes made during it go here
+static uint16_t replay_saved_settings[LED_SETTINGS_COUNT];
+static struct k_spinlock trace_lock;
+
+// State the oldest entry applies to. Power-on state until the first clear, then
+// moved forward over every entry the ring overwrites.
+static struct {
+    uint32_t time_ms;
+    uint16_t inputs[NUM_LED_INPUTS];
+    uint16_t settings[LED_SETTINGS_COUNT];
+} trace_origin = {.settings = LED_SETTINGS_DEFAULTS};
+
+static void trace_origin_fold(const struct led_trace_entry *entry) {
+    trace_origin.time_ms = entry->time_ms;
+    if (entry->event == LED_TRACE_SETTING) {
+        trace_origin.settings[entry->arg] = entry->value;
+    } else if (entry->event < NUM_LED_INPUTS && input_snapshots[entry->event]) {
+        trace_origin.inputs[entry->event] = entry->value;
+    }
+}
 
-    if (segment < filled_segments) {
-        // full segment
-        if (charging) {
-            config.color = COLOR_CHARGING_GREEN;
-        } else if (is_critical) {
-            config.color = COLOR_BATTERY_RED;
-            config.animation = ANIM_BREATH;
-        } else if (segment == 0 && battery_pct < BATTERY_LOW_THRESHOLD) {
-            config.color = COLOR_BATTERY_YELLOW;
-        } else {
-            config.color = COLOR_BATTERY_WHITE;
-        }
-    } else if (segment == filled_segments && filled_segments < NUM_SEGMENTS) {
-        // partial segment
-        if (charging) {
-            config.color = COLOR_CHARGING_GREEN;
-            if (actively_charging) {
-                config.animation = ANIM_BREATH;
-            }
-        } else if (is_critical) {
-            config.color = COLOR_BATTERY_RED;
-            config.animation = ANIM_BREATH;
-        } else {
-#ifdef CONFIG_VISORBEARER_LED_BAR_BATTERY_GRANULAR
-            uint8_t segment_start = filled_segments * BATTERY_PER_SEGMENT;
-            uint8_t pct_in_segment = battery_pct - segment_start;
+static void trace_record(uint8_t event, uint8_t arg, uint16_t value) {
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
 
-            if (pct_in_segment < 8) {
-                config.color = is_critical ? COLOR_BACKGROUND_RED : COLOR_BACKGROUND;
-            } else {
-                bool is_yellow = (segment == 0 && battery_pct < BATTERY_LOW_THRESHOLD);
-                if (pct_in_segment < 17) {
-                    config.color = is_yellow ? COLOR_BATTERY_YELLOW_MID : COLOR_BATTERY_WHITE_MID;
-                } else {
-                    config.color = is_yellow ? COLOR_BATTERY_YELLOW : COLOR_BATTERY_WHITE;
-                }
-            }
-#else
-            config.color = (segment == 0 && battery_pct < BATTERY_LOW_THRESHOLD) ?
-                          COLOR_BATTERY_YELLOW : COLOR_BATTERY_WHITE;
-#endif
+    if (!trace_replaying) {
+        if (trace_count == LED_TRACE_ENTRIES) {
+            trace_origin_fold(&trace_entries[trace_head]);
         }
+        trace_entries[trace_head] = (struct led_trace_entry){
+            .time_ms = k_uptime_get_32(),
+            .value = value,
+            .event = event,
+            .arg = arg,
+        };
+        trace_head = (trace_head + 1) % LED_TRACE_ENTRIES;
+        trace_count = MIN(trace_count + 1, LED_TRACE_ENTRIES);
     }
 
-    return config;
+    k_spin_unlock(&trace_lock, key);
 }
 
-static void display_connection_status(void) {
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        if (i == system_state.active_profile) {
-            enum color_index color = system_state.connected ? COLOR_PROFILE_CONNECTED :
-                                    system_state.advertising ? COLOR_PROFILE_OPEN :
-                                    COLOR_PROFILE_PAIRED;
+// Oldest entry first
+static const struct led_trace_entry *trace_entry(size_t i) {
+    return &trace_entries[(trace_head + LED_TRACE_ENTRIES - trace_count + i) % LED_TRACE_ENTRIES];
+}
 
-            enum animation_type anim = (system_state.advertising ||
-                                       (!system_state.connected && !system_state.advertising))
-                                       ? ANIM_BREATH : ANIM_FADE;
+static uint16_t input_snapshot(enum led_input input) {
+    return input_snapshots[input] ? atomic_get(input_snapshots[input]) : 0;
+}
 
-            segment_set(&conn_bar.segments[i], color, MAX_BRIGHTNESS, anim, LED_FADE_STEP_SIZE);
-        } else {
-            segment_set(&conn_bar.segments[i], COLOR_BACKGROUND, MAX_BRIGHTNESS,
-                       ANIM_FADE, LED_FADE_STEP_SIZE);
+// Put the origin's snapshots and settings in place and have the renderer start
+// over from them. Not recorded, a replay does the same from the same origin.
+static void trace_origin_post(void) {
+    for (int i = 0; i < NUM_LED_INPUTS; i++) {
+        if (input_snapshots[i]) {
+            atomic_set(input_snapshots[i], trace_origin.inputs[i]);
         }
     }
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        atomic_set(&settings_snapshot[i], trace_origin.settings[i]);
+    }
+    atomic_or(&pending_inputs, LED_TRACE_ORIGIN_INPUTS);
+    renderer_wake(false);
 }
+#endif
 
-static void display_modifiers(void) {
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        if (system_state.modifiers[i]) {
-            segment_set(&conn_bar.segments[i], COLOR_MODIFIER_ACTIVE, MAX_BRIGHTNESS,
-                       ANIM_FADE, MODIFIER_FADE_STEP_SIZE);
-        } else {
-            segment_set(&conn_bar.segments[i], conn_bar.segments[i].color[0] == 0 ?
-                       COLOR_OFF : COLOR_MODIFIER_ACTIVE, 0, ANIM_FADE, MODIFIER_FADE_STEP_SIZE);
-        }
-    }
+static void post_input(enum led_input input) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+    trace_record(input, 0, input_snapshot(input));
+#endif
+    atomic_set_bit(&pending_inputs, input);
+    renderer_wake((BIT(input) & LED_URGENT_INPUTS) != 0);
 }
 
-static void display_battery_status(void) {
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        struct battery_segment_config config = get_battery_segment_config(
-            i, system_state.battery_percentage, system_state.charging, system_state.actively_charging);
+// Serializes read-modify-write of the settings, readers just load one value
+static struct k_spinlock settings_lock;
 
-        segment_set(&batt_bar.segments[i], config.color, MAX_BRIGHTNESS,
-                   config.animation, LED_FADE_STEP_SIZE);
-    }
+// While a trace is replayed it owns the live settings, user changes wait for it to end
+static bool settings_follow_trace(void) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+    return trace_replaying;
+#else
+    return false;
+#endif
 }
 
-static void fade_out_bar(struct led_bar *bar) {
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        bar->segments[i].target_brightness = 0;
-        bar->segments[i].animation = ANIM_FADE;
-        bar->segments[i].fade_step = LED_FADE_STEP_SIZE;
+// The user's value of a setting, the one that is saved
+static uint16_t setting_user_value(uint8_t setting) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+    if (trace_replaying) {
+        return replay_saved_settings[setting];
     }
+#endif
+    return atomic_get(&settings_snapshot[setting]);
 }
 
-static bool bars_animating(void) {
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        if (conn_bar.segments[i].animation != ANIM_NONE ||
-            batt_bar.segments[i].animation != ANIM_NONE) {
-            return true;
-        }
+// Call with settings_lock held
+static int setting_store(uint8_t setting, int value) {
+    const struct led_setting_info *info = &setting_info[setting];
+
+    value = CLAMP(value, info->min, info->max);
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+    if (trace_replaying) {
+        replay_saved_settings[setting] = value;
+        return value;
     }
-    return false;
+    trace_record(LED_TRACE_SETTING, setting, value);
+#endif
+    atomic_set(&settings_snapshot[setting], value);
+    return value;
 }
 
+#if IS_ENABLED(CONFIG_SETTINGS)
+#define LED_SETTINGS_KEY "visorbearer/led/settings"
 
-static void update_ble_state(void) {
-    system_state.connected = zmk_ble_active_profile_is_connected();
-    system_state.advertising = zmk_ble_active_profile_is_open() && !system_state.connected;
-}
+static void settings_save_handler(struct k_work *work) {
+    uint16_t values[LED_SETTINGS_COUNT];
 
-static void update_charging_state(void) {
-    int64_t now = k_uptime_get();
-    if (now - system_state.last_charging_check >= CHARGING_CHECK_THROTTLE_MS) {
-        system_state.actively_charging = is_actively_charging();
-        system_state.last_charging_check = now;
+    k_spinlock_key_t key = k_spin_lock(&settings_lock);
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        values[i] = setting_user_value(i);
     }
-}
+    k_spin_unlock(&settings_lock, key);
 
-static void update_bars(void) {
-    int64_t current_time = k_uptime_get();
-
-    if (batt_bar.expire_time > 0 && system_state.charging) {
-        update_charging_state();
+    int err = settings_save_one(LED_SETTINGS_KEY, values, sizeof(values));
+    if (err < 0) {
+        LOG_ERR("Failed to save LED settings (%d)", err);
     }
+}
 
-    if (conn_bar.expire_time > 0 && current_time >= conn_bar.expire_time) {
-        conn_bar.expire_time = 0;
-        if (!conn_bar.showing_modifiers) {
-            fade_out_bar(&conn_bar);
-        }
-    }
+static K_WORK_DELAYABLE_DEFINE(settings_save_work, settings_save_handler);
 
-    if (conn_bar.expire_time > 0 && !conn_bar.showing_modifiers) {
-        display_connection_status();
-    } else if (any_modifier_active()) {
-        conn_bar.showing_modifiers = true;
-        display_modifiers();
-    } else if (conn_bar.showing_modifiers) {
-        conn_bar.showing_modifiers = false;
-        fade_out_bar(&conn_bar);
-    }
+static int led_settings_load(const char *name, size_t len, settings_read_cb read_cb,
+                             void *cb_arg) {
+    uint16_t values[LED_SETTINGS_COUNT];
+    const char *next;
+    int rc;
 
-    if (batt_bar.expire_time > 0 && current_time >= batt_bar.expire_time) {
-        batt_bar.expire_time = 0;
-        fade_out_bar(&batt_bar);
+    if (!settings_name_steq(name, "settings", &next) || next) {
+        return -ENOENT;
+    }
+    // a shorter blob predates the newer settings, those keep their defaults
+    if (len > sizeof(values) || len % sizeof(values[0]) != 0) {
+        return -EINVAL;
     }
 
-    if (batt_bar.expire_time > 0) {
-        display_battery_status();
+    rc = read_cb(cb_arg, values, len);
+    if (rc < 0) {
+        return rc;
     }
 
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        segment_update(&conn_bar.segments[i]);
-        segment_update(&batt_bar.segments[i]);
-        segment_write_hardware(led_conn_dev, i, &conn_bar.segments[i]);
-        segment_write_hardware(led_batt_dev, i, &batt_bar.segments[i]);
+    for (size_t i = 0; i < len / sizeof(values[0]); i++) {
+        setting_store(i, values[i]);
     }
+    post_input(LED_INPUT_SETTINGS);
+    return 0;
 }
 
-static void show_connection_status(void) {
-    int64_t new_expire = k_uptime_get() + LED_EVENT_DISPLAY_TIME_MS;
-    if (conn_bar.expire_time < new_expire) {
-        conn_bar.expire_time = new_expire;
+SETTINGS_STATIC_HANDLER_DEFINE(visorbearer_led, "visorbearer/led", NULL, led_settings_load, NULL,
+                               NULL);
+#endif
+
+static void settings_changed(void) {
+    if (!settings_follow_trace()) {
+        post_input(LED_INPUT_SETTINGS);
     }
-    conn_bar.showing_modifiers = false;
-    k_sem_give(&led_update_sem);
+#if IS_ENABLED(CONFIG_SETTINGS)
+    // every change restarts the wait, a burst of adjustments is one flash write
+    k_work_reschedule(&settings_save_work, K_MSEC(CONFIG_ZMK_SETTINGS_SAVE_DEBOUNCE));
+#endif
 }
 
-static void show_battery_status(void) {
-    int64_t new_expire = k_uptime_get() + LED_EVENT_DISPLAY_TIME_MS;
-    if (batt_bar.expire_time < new_expire) {
-        batt_bar.expire_time = new_expire;
+int led_setting_get(uint8_t setting) {
+    if (setting >= LED_SETTINGS_COUNT) {
+        return -EINVAL;
     }
-    k_sem_give(&led_update_sem);
+    return setting_user_value(setting);
 }
 
-static void update_modifier_state(uint8_t keycode, bool pressed) {
-    int segment = -1;
-
-    switch (keycode) {
-        case HID_USAGE_KEY_KEYBOARD_LEFTSHIFT:
-        case HID_USAGE_KEY_KEYBOARD_RIGHTSHIFT:
-            segment = MOD_SEGMENT_SHIFT;
-            break;
-        case HID_USAGE_KEY_KEYBOARD_LEFTCONTROL:
-        case HID_USAGE_KEY_KEYBOARD_RIGHTCONTROL:
-            segment = MOD_SEGMENT_CTRL;
-            break;
-        case HID_USAGE_KEY_KEYBOARD_LEFTALT:
-        case HID_USAGE_KEY_KEYBOARD_RIGHTALT:
-            segment = MOD_SEGMENT_ALT;
-            break;
-        case HID_USAGE_KEY_KEYBOARD_LEFT_GUI:
-        case HID_USAGE_KEY_KEYBOARD_RIGHT_GUI:
-            segment = MOD_SEGMENT_GUI;
-            break;
+int led_setting_set(uint8_t setting, int value) {
+    if (setting >= LED_SETTINGS_COUNT) {
+        return -EINVAL;
     }
 
-    if (segment >= 0 && system_state.modifiers[segment] != pressed) {
-        system_state.modifiers[segment] = pressed;
-        k_sem_give(&led_update_sem);
-    }
+    k_spinlock_key_t key = k_spin_lock(&settings_lock);
+    value = setting_store(setting, value);
+    k_spin_unlock(&settings_lock, key);
+
+    settings_changed();
+    return value;
 }
 
-static int led_init(void) {
-    led_conn_dev = DEVICE_DT_GET(LPA_NODE);
-    led_batt_dev = DEVICE_DT_GET(LPB_NODE);
+int led_setting_adjust(uint8_t setting, int delta) {
+    int value;
 
-    if (!device_is_ready(led_conn_dev) || !device_is_ready(led_batt_dev)) {
-        LOG_ERR("LED devices not ready");
-        return -ENODEV;
+    if (setting >= LED_SETTINGS_COUNT) {
+        return -EINVAL;
     }
 
-    // config charging input pin
-    gpio0_dev = DEVICE_DT_GET(DT_NODELABEL(gpio0));
-    if (!device_is_ready(gpio0_dev)) {
-        LOG_ERR("GPIO0 device not ready");
-        return -ENODEV;
-    }
+    k_spinlock_key_t key = k_spin_lock(&settings_lock);
+    value = setting_store(setting, setting_user_value(setting) + delta);
+    k_spin_unlock(&settings_lock, key);
 
+    settings_changed();
+    return value;
+}
 
-    memset(&conn_bar, 0, sizeof(conn_bar));
-    memset(&batt_bar, 0, sizeof(batt_bar));
-    for (int i = 0; i < NUM_SEGMENTS; i++) {
-        conn_bar.segments[i].dirty = true;
-        batt_bar.segments[i].dirty = true;
+void led_settings_reset(void) {
+    k_spinlock_key_t key = k_spin_lock(&settings_lock);
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        setting_store(i, setting_defaults[i]);
     }
+    k_spin_unlock(&settings_lock, key);
 
-    system_state.active_profile = zmk_ble_active_profile_index();
-    update_ble_state();
-    system_state.battery_percentage = zmk_battery_state_of_charge();
-    system_state.charging = zmk_usb_is_powered();
-    system_state.actively_charging = is_actively_charging();
-    system_state.last_charging_check = k_uptime_get();
+    settings_changed();
+}
 
-    zmk_mod_flags_t mods = zmk_hid_get_explicit_mods();
-    system_state.modifiers[MOD_SEGMENT_SHIFT] = (mods & (MOD_LSFT | MOD_RSFT)) != 0;
-    system_state.modifiers[MOD_SEGMENT_CTRL] = (mods & (MOD_LCTL | MOD_RCTL)) != 0;
-    system_state.modifiers[MOD_SEGMENT_ALT] = (mods & (MOD_LALT | MOD_RALT)) != 0;
-    system_state.modifiers[MOD_SEGMENT_GUI] = (mods & (MOD_LGUI | MOD_RGUI)) != 0;
+static uint32_t anim_progress(int64_t elapsed, uint32_t duration) {
+    if (elapsed <= 0) return 0;
+    if (elapsed >= duration) return Q16_ONE;
+    return (uint32_t)((elapsed << 16) / duration);
+}
 
-    // wait for valid battery reading
-    for (int retry = 0; retry < 10 && system_state.battery_percentage == 0; retry++) {
-        k_sleep(K_MSEC(10));
-        system_state.battery_percentage = zmk_battery_state_of_charge();
+static uint32_t anim_ease(enum easing easing, uint32_t p) {
+    switch (easing) {
+        case EASE_IN_OUT:
+            // smoothstep: 3p^2 - 2p^3
+            return (uint32_t)((((uint64_t)p * p) >> 16) * (3 * Q16_ONE - 2 * p) >> 16);
+        case EASE_LINEAR:
+        default:
+            return p;
     }
+}
+
+static uint8_t lerp_u8(uint8_t from, uint8_t to, uint32_t p) {
+    return from + ((((int32_t)to - from) * (int32_t)p + Q16_ONE / 2) >> 16);
+}
 
-    // startup animation
-    for (int stage = 0; stage < NUM_SEGMENTS; stage++) {
-        int conn_idx = NUM_SEGMENTS - 1 - stage;
-        int batt_idx = stage;
+// Whether the segment still has keyframes to play
+static bool segment_animating(const struct led_segment *seg) {
+    return seg->pattern && seg->cursor < seg->pattern->num_frames;
+}
+
+// Play pattern from where the segment is now, its LED_PATTERN_SPAN units taking duration_ms
+static void segment_start(struct led_segment *seg, const struct led_pattern *pattern,
+                          uint16_t duration_ms, int64_t start_time) {
+    // a dark segment has no color to blend from
+    memcpy(seg->from_color, seg->brightness > 0 ? seg->color : seg->target_color, 3);
+    seg->from_brightness = seg->brightness;
+    seg->pattern = pattern;
+    seg->cursor = 0;
+    seg->duration_ms = MAX(1, duration_ms);
+    seg->start_time = start_time;
+}
 
-        segment_set(&conn_bar.segments[conn_idx], COLOR_BACKGROUND, MAX_BRIGHTNESS,
-                   ANIM_FADE, LED_INIT_FADE_STEP_SIZE);
-        segment_set(&batt_bar.segments[batt_idx], COLOR_BACKGROUND, MAX_BRIGHTNESS,
-                   ANIM_FADE, LED_INIT_FADE_STEP_SIZE);
+static void segment_start_fade(struct led_segment *seg, const uint8_t color[3], uint8_t target,
+                               const struct anim_timing *timing) {
+    // fades move at a constant speed, so partial fades take proportionally less time
+    uint32_t distance = abs(target - seg->brightness) * 0xFF / MAX_BRIGHTNESS;
 
-        while (conn_bar.segments[conn_idx].animation != ANIM_NONE ||
-               batt_bar.segments[batt_idx].animation != ANIM_NONE) {
-            segment_update(&conn_bar.segments[conn_idx]);
-            segment_update(&batt_bar.segments[batt_idx]);
-            segment_write_hardware(led_conn_dev, conn_idx, &conn_bar.segments[conn_idx]);
-            segment_write_hardware(led_batt_dev, batt_idx, &batt_bar.segments[batt_idx]);
-            k_sleep(K_MSEC(10));
+    if (seg->brightness > 0) {
+        for (int c = 0; c < 3; c++) {
+            distance = MAX(distance, abs(color[c] - seg->color[c]));
         }
-
-        LOG_DBG("Init fade stage %d complete", stage + 1);
     }
 
-    k_sleep(K_MSEC(LED_INIT_PAUSE_TIME_MS));
+    memcpy(seg->target_color, color, 3);
+    seg->target_brightness = target;
+    segment_start(seg, timing->fade, timing->duration_ms * distance / 0xFF, frame_time);
+}
+
+static void segment_set(struct led_segment *seg, const uint8_t color[3],
+                       uint8_t target, enum animation_type anim,
+                       const struct anim_timing *timing) {
+    const struct led_pattern *pattern = anim == ANIM_BREATH ? &breath_pattern :
+                                        anim == ANIM_FADE ? timing->fade : NULL;
+
+    // Only update if something actually changes, a finished fade still counts as a fade
+    if (memcmp(seg->target_color, color, 3) == 0 && seg->target_brightness == target &&
+        seg->pattern == pattern) {
+        return;
+    }
+
+    switch (anim) {
+        case ANIM_FADE:
+            segment_start_fade(seg, color, target, timing);
+            break;
+
+        case ANIM_BREATH: {
+            uint16_t period = led_settings[LED_SETTING_BREATH_PERIOD_MS];
+            int64_t start_time = frame_time;
+
+            // join the cycle at whichever end is closer to the current level
+            if (seg->brightness <
+                (led_settings[LED_SETTING_BREATH_MIN] + led_settings[LED_SETTING_BREATH_MAX]) / 2) {
+                start_time -= period / 2;
+            }
+            memcpy(seg->target_color, color, 3);
+            seg->target_brightness = target;
+            segment_start(seg, &breath_pattern, period, start_time);
+            break;
+        }
+
+        case ANIM_NONE:
+        default:
+            memcpy(seg->target_color, color, 3);
+            memcpy(seg->color, color, 3);
+            seg->target_brightness = target;
+            seg->brightness = target;
+            seg->pattern = NULL;
+            seg->dirty = true;
+            break;
+    }
+}
+
+// Start a devicetree pattern, phase_ms after the current frame. Asking again for the
+// pattern the segment already plays, or has finished playing once, changes nothing.
+static void segment_play(struct led_segment *seg, const struct led_pattern *pattern,
+                         const uint8_t color[3], uint8_t target, uint16_t phase_ms) {
+    if (seg->pattern == pattern) return;
+
+    memcpy(seg->target_color, color, 3);
+    seg->target_brightness = target;
+    segment_start(seg, pattern, LED_PATTERN_SPAN, frame_time + phase_ms);
+}
+
+static const uint8_t *keyframe_color(const struct led_segment *seg,
+                                     const struct led_keyframe *frame) {
+    switch (frame->color_ref) {
+        case KEYFRAME_FROM:
+            return seg->from_color;
+        case KEYFRAME_TARGET:
+            return seg->target_color;
+        default:
+            return frame->color;
+    }
+}
+
+static uint8_t keyframe_brightness(const struct led_segment *seg,
+                                   const struct led_keyframe *frame) {
+    switch (frame->brightness_ref) {
+        case KEYFRAME_FROM:
+            return seg->from_brightness;
+        case KEYFRAME_TARGET:
+            return seg->target_brightness;
+        case KEYFRAME_BREATH_MIN:
+            return led_settings[LED_SETTING_BREATH_MIN];
+        case KEYFRAME_BREATH_MAX:
+            return led_settings[LED_SETTING_BREATH_MAX];
+        default:
+            return frame->brightness;
+    }
+}
+
+// Step the segment's pattern to frame_time. The cursor only moves forward within a
+// cycle, so most frames look at a single keyframe pair.
+static void segment_update(struct led_segment *seg) {
+    if (!segment_animating(seg)) return;
+
+    const struct led_pattern *pattern = seg->pattern;
+    const struct led_keyframe *frames = pattern->frames;
+    const struct led_keyframe *last = &frames[pattern->num_frames - 1];
+    int64_t t = MAX(frame_time - seg->start_time, 0) * LED_PATTERN_SPAN / seg->duration_ms;
+    const uint8_t *color;
+    uint8_t blended[3];
+    uint8_t level;
+
+    if (t >= last->time && (!pattern->loop || last->time == 0)) {
+        // done, hold the last keyframe as a static segment
+        seg->cursor = pattern->num_frames;
+        color = keyframe_color(seg, last);
+        level = keyframe_brightness(seg, last);
+    } else {
+        if (pattern->loop) {
+            t %= last->time;
+            // came around to the start of the cycle again
+            if (seg->cursor > 0 && frames[seg->cursor - 1].time > t) {
+                seg->cursor = 0;
+            }
+        }
+        while (seg->cursor < pattern->num_frames - 1 && frames[seg->cursor].time <= t) {
+            seg->cursor++;
+        }
+
+        const struct led_keyframe *next = &frames[seg->cursor];
+
+        if (seg->cursor == 0) {
+            // delayed start, or a first keyframe later than 0
+            color = keyframe_color(seg, next);
+            level = keyframe_brightness(seg, next);
+        } else {
+            const struct led_keyframe *prev = next - 1;
+            const uint8_t *from = keyframe_color(seg, prev);
+            const uint8_t *to = keyframe_color(seg, next);
+            uint32_t p = anim_ease(next->easing,
+                                   anim_progress(t - prev->time, next->time - prev->time));
+
+            for (int c = 0; c < 3; c++) {
+                blended[c] = lerp_u8(from[c], to[c], p);
+            }
+            color = blended;
+            level = lerp_u8(keyframe_brightness(seg, prev), keyframe_brightness(seg, next), p);
+        }
+    }
+
+    if (memcmp(seg->color, color, 3) != 0) {
+        memcpy(seg->color, color, 3);
+        seg->dirty = true;
+    }
+    if (level != seg->brightness) {
+        seg->brightness = level;
+        seg->dirty = true;
+    }
+}
+
+// The kind of animation a segment runs, for the stats
+static enum animation_type segment_animation(const struct led_segment *seg) {
+    if (!segment_animating(seg)) return ANIM_NONE;
+    if (seg->pattern == &breath_pattern) return ANIM_BREATH;
+    if (seg->pattern == &fade_pattern || seg->pattern == &linear_fade_pattern) return ANIM_FADE;
+    return ANIM_PATTERN;
+}
+
+// How often a segment needs a new frame, 0 when it is static
+static uint16_t segment_frame_interval(const struct led_segment *seg) {
+    if (!segment_animating(seg)) return 0;
+
+    // the transition under way, or the wait for a delayed or late first keyframe
+    const struct led_keyframe *frames = seg->pattern->frames;
+    uint32_t span = seg->cursor > 0 ? frames[seg->cursor].time - frames[seg->cursor - 1].time
+                                    : frames[0].time;
+
+    span = MAX(1, span * seg->duration_ms / LED_PATTERN_SPAN);
+    return CLAMP(span / LED_ANIM_FRAMES, LED_FRAME_MIN_MS, LED_FRAME_MAX_MS);
+}
+
+static int chip_write(struct led_chip *chip, const uint8_t *channels, int first, int last) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+    // queued for the frame's async transaction, sent once every chip is committed;
+    // the shadow is updated now and a failed transfer invalidates it again
+    struct i2c_msg *msg = &chip->msgs[chip->num_msgs++];
+    uint8_t *buf = &chip->tx[chip->tx_len];
+
+    buf[0] = LP50XX_LED_CONFIG0 + first;
+    memcpy(&buf[1], &channels[first], last - first + 1);
+    chip->tx_len += last - first + 2;
+
+    msg->buf = buf;
+    msg->len = last - first + 2;
+    msg->flags = I2C_MSG_WRITE | (chip->num_msgs > 1 ? I2C_MSG_RESTART : 0);
+#else
+    // by register address, the LED driver has no access to the bank registers
+    int err = i2c_burst_write_dt(&chip->bus, LP50XX_LED_CONFIG0 + first, &channels[first],
+                                 last - first + 1);
+    if (err < 0) {
+        LOG_ERR("Failed to write %s registers %d-%d (%d)", chip->dev->name, first, last, err);
+        chip->write_errors++;
+        return err;
+    }
+#endif
+
+    memcpy(&chip->shadow[first], &channels[first], last - first + 1);
+    chip->bursts_written++;
+    chip->bytes_written += last - first + 1;
+    return 0;
+}
+
+// Write the channels in [from, to) that differ from the shadow, in as few bursts as pay off
+static int chip_flush_range(struct led_chip *chip, const uint8_t *channels, int from, int to,
+                            int *sent) {
+    int first = -1;
+    int last = -1;
+    int err = 0;
+
+    for (int ch = from; ch < to; ch++) {
+        if (chip->shadow_valid && chip->shadow[ch] == channels[ch]) continue;
+
+        if (first >= 0 && ch - last - 1 > LP50XX_BURST_OVERHEAD) {
+            *sent += last - first + 1;
+            int ret = chip_write(chip, channels, first, last);
+            if (ret < 0) err = ret;
+            first = -1;
+        }
+        if (first < 0) first = ch;
+        last = ch;
+    }
+
+    if (first >= 0) {
+        *sent += last - first + 1;
+        int ret = chip_write(chip, channels, first, last);
+        if (ret < 0) err = ret;
+    }
+    return err;
+}
+
+// Write only the channels that differ from the shadow. LED_CONFIG goes out last, so
+// LEDs switch in or out of bank mode only once the registers they switch to are set.
+static int chip_flush(struct led_chip *chip, const uint8_t *channels) {
+    int num_channels = LP50XX_CHANNELS(chip->max_leds);
+    int config_channels = LP50XX_CONFIG_CHANNELS(chip->max_leds);
+    int sent = 0;
+    int err;
+
+    err = chip_flush_range(chip, channels, config_channels, num_channels, &sent);
+    if (err == 0) {
+        err = chip_flush_range(chip, channels, 0, config_channels, &sent);
+    }
+
+    if (sent == 0) {
+        chip->bursts_skipped++;
+    }
+    chip->bytes_skipped += num_channels - sent;
+    if (err == 0) {
+        chip->shadow_valid = true;
+    }
+    return err;
+}
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_POWER_DOWN
+static void chip_power_down(struct led_chip *chip) {
+    // going through PM keeps ZMK's sleep path from suspending the chip a second time
+    int err = pm_device_action_run(chip->dev, PM_DEVICE_ACTION_SUSPEND);
+    if (err < 0 && err != -EALREADY) {
+        LOG_WRN("Failed to suspend %s (%d)", chip->dev->name, err);
+        return;
+    }
+
+    if (chip->enable.port) {
+        // shutdown resets every register
+        gpio_pin_set_dt(&chip->enable, 0);
+        chip->shadow_valid = false;
+    }
+
+    chip->powered = false;
+    chip->powered_ms += k_uptime_get() - chip->powered_since;
+    LOG_DBG("%s powered down", chip->dev->name);
+}
+
+static int chip_power_up(struct led_chip *chip) {
+    int err;
+
+    if (chip->enable.port) {
+        gpio_pin_set_dt(&chip->enable, 1);
+        k_usleep(LP50XX_ENABLE_DELAY_US);
+    }
+
+    err = pm_device_action_run(chip->dev, PM_DEVICE_ACTION_RESUME);
+    if (err < 0 && err != -EALREADY) {
+        LOG_ERR("Failed to resume %s (%d)", chip->dev->name, err);
+        return err;
+    }
+
+    if (chip->enable.port) {
+        // restore what lp50xx_init() configured before the shutdown
+        err = i2c_reg_write_byte_dt(&chip->bus, LP50XX_DEVICE_CONFIG0, LP50XX_CHIP_EN);
+        if (err == 0) {
+            err = i2c_reg_update_byte_dt(&chip->bus, LP50XX_DEVICE_CONFIG1,
+                                         LP50XX_LOG_SCALE_EN | LP50XX_MAX_CURR_OPT, chip->config1);
+        }
+        if (err < 0) {
+            LOG_ERR("Failed to configure %s (%d)", chip->dev->name, err);
+            return err;
+        }
+    }
+
+    chip->powered = true;
+    chip->powered_since = k_uptime_get();
+    LOG_DBG("%s powered up", chip->dev->name);
+    return 0;
+}
+#endif
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+// Chips with bursts queued this frame. Each transfer's completion starts the
+// next chip's, the renderer only waits for the chain before the next flush.
+static struct led_chip *flush_chain[ARRAY_SIZE(chips)];
+static size_t flush_chain_len;
+static size_t flush_chain_pos;
+static bool flush_wake;   // run a frame once the chain is done
+static K_SEM_DEFINE(flush_idle_sem, 1, 1);
+
+static void flush_chain_next(void);
+
+static void flush_failed(struct led_chip *chip, int err) {
+    LOG_ERR("Failed to write %s (%d)", chip->dev->name, err);
+    chip->write_errors++;
+    chip->shadow_valid = false;
+    chip->resync = true;
+    flush_wake = true;
+}
+
+static void flush_transfer_done(const struct device *dev, int result, void *data) {
+    if (result < 0) {
+        flush_failed(data, result);
+    }
+    flush_chain_next();
+}
+
+// Called from the renderer to start the chain, then from each completion callback
+static void flush_chain_next(void) {
+    while (flush_chain_pos < flush_chain_len) {
+        struct led_chip *chip = flush_chain[flush_chain_pos++];
+        int err = i2c_transfer_cb_dt(&chip->bus, chip->msgs, chip->num_msgs,
+                                     flush_transfer_done, chip);
+        if (err == 0) {
+            return;
+        }
+
+        // the controller won't queue it, write it the blocking way where that is allowed
+        if (!k_is_in_isr()) {
+            err = i2c_transfer_dt(&chip->bus, chip->msgs, chip->num_msgs);
+        }
+        if (err < 0) {
+            flush_failed(chip, err);
+        }
+    }
+
+    k_sem_give(&flush_idle_sem);
+    if (flush_wake) {
+        renderer_wake(true);
+    }
+}
+
+// Wait for the previous frame's writes, false if they never completed
+static bool flush_wait_idle(void) {
+    if (k_sem_take(&flush_idle_sem, K_MSEC(LED_FLUSH_TIMEOUT_MS)) < 0) {
+        LOG_ERR("LED flush still running after %d ms", LED_FLUSH_TIMEOUT_MS);
+        return false;
+    }
+    return true;
+}
+#endif
+
+// One chip's register image for the frame being rendered. It is built with every
+// LED on its own registers, chip_frame_bank() moves LEDs to the bank afterwards.
+struct chip_frame {
+    uint8_t channels[LP50XX_MAX_CHANNELS];
+    bool dirty;
+    bool lit;
+    uint16_t animating;  // LEDs whose segment is animating
+    bool banked;
+};
+
+// Gather every segment of the chip's bars into its register image
+static void chip_build_frame(const struct led_chip *chip, struct chip_frame *frame) {
+    memset(frame, 0, sizeof(*frame));
+
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        const struct led_bar *bar = &bars[b];
+
+        if (bar->chip != chip) continue;
+
+        for (int i = 0; i < bar->num_segments; i++) {
+            const struct led_segment *seg = &bar->segments[i];
+            uint8_t led = bar->leds[i];
+
+            // segment levels are perceptual, the chip's PWM duty is linear
+            frame->channels[LP50XX_BRIGHTNESS_CHANNEL(chip, led)] =
+                led_gamma_table[seg->brightness * led_settings[LED_SETTING_BRIGHTNESS] / MAX_BRIGHTNESS];
+            memcpy(&frame->channels[LP50XX_COLOR_CHANNEL(chip, led)], seg->color,
+                   LP50XX_COLORS_PER_LED);
+            frame->dirty |= seg->dirty;
+            frame->lit |= seg->brightness > 0;
+            if (segment_animating(seg)) {
+                frame->animating |= BIT(led);
+            }
+        }
+    }
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+    frame->dirty |= chip->resync;
+#endif
+}
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_BANK_MODE
+static bool led_output_equal(const struct led_chip *chip, const uint8_t *channels, int a, int b) {
+    return channels[LP50XX_BRIGHTNESS_CHANNEL(chip, a)] ==
+               channels[LP50XX_BRIGHTNESS_CHANNEL(chip, b)] &&
+           memcmp(&channels[LP50XX_COLOR_CHANNEL(chip, a)],
+                  &channels[LP50XX_COLOR_CHANNEL(chip, b)], LP50XX_COLORS_PER_LED) == 0;
+}
+
+// Move the largest group of animating LEDs that show the same output onto the bank
+// registers, so each frame of a shared fade or breath is one BANK_BRIGHTNESS write
+// instead of one write per LED. LEDs that diverge or hold still stay on their own.
+static void chip_frame_bank(const struct led_chip *chip, struct chip_frame *frame) {
+    uint8_t *channels = frame->channels;
+    uint16_t bank = 0;
+    int bank_size = 0;
+    int bank_led = -1;
+
+    for (int led = 0; led < chip->max_leds; led++) {
+        uint16_t same = 0;
+        int size = 0;
+
+        if (!(frame->animating & BIT(led))) continue;
+        for (int other = led; other < chip->max_leds; other++) {
+            if ((frame->animating & BIT(other)) && led_output_equal(chip, channels, led, other)) {
+                same |= BIT(other);
+                size++;
+            }
+        }
+        if (size > bank_size) {
+            bank = same;
+            bank_size = size;
+            bank_led = led;
+        }
+    }
+
+    if (bank_size < 2) {
+        // the bank registers are unused, leave whatever they hold
+        if (chip->shadow_valid) {
+            memcpy(&channels[LP50XX_BANK_BRIGHTNESS_CHANNEL(chip)],
+                   &chip->shadow[LP50XX_BANK_BRIGHTNESS_CHANNEL(chip)], LP50XX_BANK_REGS);
+        }
+        return;
+    }
+
+    channels[LP50XX_BANK_BRIGHTNESS_CHANNEL(chip)] =
+        channels[LP50XX_BRIGHTNESS_CHANNEL(chip, bank_led)];
+    memcpy(&channels[LP50XX_BANK_COLOR_CHANNEL(chip)],
+           &channels[LP50XX_COLOR_CHANNEL(chip, bank_led)], LP50XX_COLORS_PER_LED);
+
+    for (int led = 0; led < chip->max_leds; led++) {
+        if (!(bank & BIT(led))) continue;
+
+        channels[led / 8] |= BIT(led % 8);
+        // a banked LED ignores its own registers, skip writing them
+        if (chip->shadow_valid) {
+            channels[LP50XX_BRIGHTNESS_CHANNEL(chip, led)] =
+                chip->shadow[LP50XX_BRIGHTNESS_CHANNEL(chip, led)];
+            memcpy(&channels[LP50XX_COLOR_CHANNEL(chip, led)],
+                   &chip->shadow[LP50XX_COLOR_CHANNEL(chip, led)], LP50XX_COLORS_PER_LED);
+        }
+    }
+    frame->banked = true;
+}
+#endif
+
+// Write what changed in the frame and power the chip according to it
+static void chip_commit_frame(struct led_chip *chip, const struct chip_frame *frame) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+    chip->tx_len = 0;
+    chip->num_msgs = 0;
+    chip->resync = false;
+#endif
+
+    if (frame->dirty) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_POWER_DOWN
+        // a dark frame needs no writes while the chip is off
+        if (!chip->powered && frame->lit && chip_power_up(chip) < 0) return;
+        if (chip->powered && chip_flush(chip, frame->channels) < 0) return;
+#else
+        // leave segments dirty on failure so the next frame retries
+        if (chip_flush(chip, frame->channels) < 0) return;
+#endif
+
+        for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+            if (bars[b].chip != chip) continue;
+            for (int i = 0; i < bars[b].num_segments; i++) {
+                bars[b].segments[i].dirty = false;
+            }
+        }
+        if (frame->banked) {
+            chip->bank_frames++;
+        }
+    }
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+    if (chip->num_msgs > 0) {
+        chip->msgs[chip->num_msgs - 1].flags |= I2C_MSG_STOP;
+        flush_chain[flush_chain_len++] = chip;
+    }
+#endif
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_POWER_DOWN
+    if (chip->powered && !frame->lit && !frame->animating) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+        // the dark image is still to be sent, power down on the frame after it
+        if (chip->num_msgs > 0) {
+            flush_wake = true;
+            return;
+        }
+#endif
+        chip_power_down(chip);
+    }
+#endif
+}
+
+// LED output current of a register image in uA: every output sinks
+// max current * color/255 * duty/255
+static uint32_t chip_frame_current_ua(const struct led_chip *chip, const struct chip_frame *frame) {
+    uint32_t max_ua = (chip->config1 & LP50XX_MAX_CURR_OPT) ? LP50XX_MAX_CURRENT_HIGH_UA
+                                                            : LP50XX_MAX_CURRENT_UA;
+    uint64_t sum = 0;
+
+    for (int led = 0; led < chip->max_leds; led++) {
+        const uint8_t *color = &frame->channels[LP50XX_COLOR_CHANNEL(chip, led)];
+
+        sum += (uint32_t)frame->channels[LP50XX_BRIGHTNESS_CHANNEL(chip, led)] *
+               (color[0] + color[1] + color[2]);
+    }
+    return (uint32_t)(sum * max_ua / (0xFF * 0xFF));
+}
+
+#if LED_CURRENT_BUDGET_MA > 0
+// Budget for the current battery level, shrinking linearly toward
+// LED_CURRENT_BUDGET_MIN_PCT of the full budget at an empty battery. The full
+// budget applies until the first reading.
+static uint32_t current_budget_ua(void) {
+    uint8_t battery = system_state.battery_valid ? MIN(system_state.battery_percentage, 100) : 100;
+    uint32_t pct = LED_CURRENT_BUDGET_MIN_PCT + (100 - LED_CURRENT_BUDGET_MIN_PCT) * battery / 100;
+
+    return LED_CURRENT_BUDGET_MA * 1000 * pct / 100;
+}
+
+// Dim every lit output by the same factor so the frame fits the budget
+static void frames_limit_current(struct led_chip *const *frame_chips, struct chip_frame *frames,
+                                 size_t count, uint32_t current_ua) {
+    static uint32_t last_scale = Q16_ONE;
+    uint32_t budget_ua = current_budget_ua();
+    uint32_t scale = current_ua > budget_ua ? (uint32_t)((uint64_t)budget_ua * Q16_ONE / current_ua)
+                                            : Q16_ONE;
+
+    for (size_t c = 0; c < count; c++) {
+        const struct led_chip *chip = frame_chips[c];
+
+        if (scale < Q16_ONE) {
+            for (int led = 0; led < chip->max_leds; led++) {
+                uint8_t *duty = &frames[c].channels[LP50XX_BRIGHTNESS_CHANNEL(chip, led)];
+
+                // keep what is lit visible, like the gamma table does
+                if (*duty > 0) {
+                    *duty = MAX(1, (*duty * scale) >> 16);
+                }
+            }
+        }
+        // a new budget changes the image even when no segment did
+        frames[c].dirty |= scale != last_scale;
+    }
+
+    last_scale = scale;
+}
+#endif
+
+static int64_t chip_powered_ms(const struct led_chip *chip) {
+    return chip->powered_ms + (chip->powered ? k_uptime_get() - chip->powered_since : 0);
+}
+
+// Modeled LED charge drawn since boot or the last stats reset
+static uint32_t led_charge_uah(void) {
+    uint64_t ua_ms = led_stats.charge_ua_ms +
+                     (uint64_t)led_stats.current_ua * (k_uptime_get() - led_stats.current_since);
+
+    return ua_ms / (60 * 60 * 1000);
+}
+
+static void stats_reset(void) {
+    uint32_t current_ua = led_stats.current_ua;
+
+    memset(&led_stats, 0, sizeof(led_stats));
+    led_stats.current_ua = current_ua;
+    led_stats.current_since = frame_time;
+
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        struct led_chip *chip = &chips[c];
+
+        chip->bursts_written = 0;
+        chip->bursts_skipped = 0;
+        chip->bytes_written = 0;
+        chip->bytes_skipped = 0;
+        chip->write_errors = 0;
+        chip->bank_frames = 0;
+        chip->powered_ms = 0;
+        chip->powered_since = k_uptime_get();
+    }
+}
+
+// Count a rendered frame, the animations running in it and what it cost
+static void stats_frame(uint32_t cycles) {
+    uint8_t anims = 0;
+
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        for (int i = 0; i < bars[b].num_segments; i++) {
+            const struct led_segment *seg = &bars[b].segments[i];
+
+            anims |= BIT(segment_animation(seg));
+        }
+    }
+    if (anims & ~BIT(ANIM_NONE)) {
+        anims &= ~BIT(ANIM_NONE);
+    }
+    for (int a = 0; a < NUM_ANIMATION_TYPES; a++) {
+        if (anims & BIT(a)) led_stats.anim_frames[a]++;
+    }
+
+    led_stats.frames++;
+    led_stats.update_cycles += cycles;
+    led_stats.update_cycles_max = MAX(led_stats.update_cycles_max, cycles);
+}
+
+static void log_chip_stats(const struct led_chip *chip) {
+    LOG_DBG("%s: %u bursts/%u bytes written, %u bursts/%u bytes skipped", chip->dev->name,
+            chip->bursts_written, chip->bytes_written, chip->bursts_skipped, chip->bytes_skipped);
+}
+
+static bool any_modifier_active(void) {
+    return system_state.modifiers != 0;
+}
+
+static struct gpio_callback charge_status_cb;
+
+static void charge_debounce_handler(struct k_work *work) {
+    int pin_value = gpio_pin_get(gpio0_dev, CHARGE_STATUS_PIN);
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+    trace_record(LED_TRACE_CHARGE_READ, 0, pin_value);
+#endif
+
+    // If gpio_pin_get fails (returns negative), treat as not charging
+    bool charging = (pin_value == 0);
+
+    if (atomic_test_bit(&power_snapshot, POWER_SNAPSHOT_CHARGING) != charging) {
+        atomic_set_bit_to(&power_snapshot, POWER_SNAPSHOT_CHARGING, charging);
+        LOG_DBG("Actively charging: %d", charging);
+        post_input(LED_INPUT_POWER);
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(charge_debounce_work, charge_debounce_handler);
+
+static void charge_status_changed(const struct device *dev, struct gpio_callback *cb,
+                                  gpio_port_pins_t pins) {
+    k_work_reschedule(&charge_debounce_work, K_MSEC(CHARGE_DEBOUNCE_MS));
+}
+
+// The status pin is only connected while USB power is present, to minimize leakage current
+static void charge_detect_arm(bool usb_powered) {
+    atomic_set_bit_to(&power_snapshot, POWER_SNAPSHOT_USB, usb_powered);
+    post_input(LED_INPUT_POWER);
+
+    if (!gpio0_dev) return;
+
+    if (usb_powered) {
+        gpio_pin_configure(gpio0_dev, CHARGE_STATUS_PIN, GPIO_INPUT);
+        gpio_pin_interrupt_configure(gpio0_dev, CHARGE_STATUS_PIN, GPIO_INT_EDGE_BOTH);
+        k_work_reschedule(&charge_debounce_work, K_MSEC(CHARGE_DEBOUNCE_MS));
+    } else {
+        gpio_pin_interrupt_configure(gpio0_dev, CHARGE_STATUS_PIN, GPIO_INT_DISABLE);
+        gpio_pin_configure(gpio0_dev, CHARGE_STATUS_PIN, GPIO_DISCONNECTED);
+        k_work_cancel_delayable(&charge_debounce_work);
+        atomic_clear_bit(&power_snapshot, POWER_SNAPSHOT_CHARGING);
+    }
+}
+
+static struct battery_segment_config get_battery_segment_config(int segment,
+                                                                int num_segments,
+                                                                uint8_t battery_pct,
+                                                                bool charging,
+                                                                bool actively_charging) {
+    bool is_critical = battery_pct < led_settings[LED_SETTING_BATTERY_CRITICAL] && !charging;
+    bool is_low = battery_pct < led_settings[LED_SETTING_BATTERY_LOW];
+
+    struct battery_segment_config config = {
+        .color = is_critical ? COLOR_BACKGROUND_RED : COLOR_BACKGROUND,
+        .animation = ANIM_FADE
+    };
+
+    uint8_t per_segment = 100 / num_segments;
+    uint8_t filled_segments = battery_pct / per_segment;
+
+    if (segment < filled_segments) {
+        // full segment
+        if (charging) {
+            config.color = COLOR_CHARGING_GREEN;
+        } else if (is_critical) {
+            config.color = COLOR_BATTERY_RED;
+            config.animation = ANIM_BREATH;
+        } else if (segment == 0 && is_low) {
+            config.color = COLOR_BATTERY_YELLOW;
+        } else {
+            config.color = COLOR_BATTERY_WHITE;
+        }
+    } else if (segment == filled_segments && filled_segments < num_segments) {
+        // partial segment
+        if (charging) {
+            config.color = COLOR_CHARGING_GREEN;
+            if (actively_charging) {
+                config.animation = ANIM_BREATH;
+            }
+        } else if (is_critical) {
+            config.color = COLOR_BATTERY_RED;
+            config.animation = ANIM_BREATH;
+        } else {
+#ifdef CONFIG_VISORBEARER_LED_BAR_BATTERY_GRANULAR
+            uint8_t segment_start = filled_segments * per_segment;
+            uint8_t pct_in_segment = battery_pct - segment_start;
+
+            // thirds of the segment, rounded so 4 segments split at 8% and 17%
+            if (pct_in_segment < DIV_ROUND_CLOSEST(per_segment, 3)) {
+                config.color = is_critical ? COLOR_BACKGROUND_RED : COLOR_BACKGROUND;
+            } else {
+                bool is_yellow = (segment == 0 && is_low);
+                if (pct_in_segment < DIV_ROUND_CLOSEST(2 * per_segment, 3)) {
+                    config.color = is_yellow ? COLOR_BATTERY_YELLOW_MID : COLOR_BATTERY_WHITE_MID;
+                } else {
+                    config.color = is_yellow ? COLOR_BATTERY_YELLOW : COLOR_BATTERY_WHITE;
+                }
+            }
+#else
+            config.color = (segment == 0 && is_low) ?
+                          COLOR_BATTERY_YELLOW : COLOR_BATTERY_WHITE;
+#endif
+        }
+    }
+
+    return config;
+}
+
+static void pixel_set(struct led_pixel *pixel, enum color_index color, uint8_t brightness,
+                      enum animation_type anim, const struct anim_timing *timing) {
+    memcpy(pixel->color, colors[color], 3);
+    pixel->brightness = brightness;
+    pixel->animation = anim;
+    pixel->timing = timing;
+    pixel->set = true;
+}
+
+// Blend a layer pixel over what the layers below produced
+static void pixel_blend(struct led_pixel *dst, const struct led_pixel *src, uint8_t opacity) {
+    uint32_t p = opacity * Q16_ONE / 0xFF;
+
+    if (!dst->set) {
+        *dst = *src;
+        dst->brightness = lerp_u8(0, src->brightness, p);
+        return;
+    }
+
+    for (int c = 0; c < 3; c++) {
+        dst->color[c] = lerp_u8(dst->color[c], src->color[c], p);
+    }
+    dst->brightness = lerp_u8(dst->brightness, src->brightness, p);
+    dst->animation = src->animation;
+    dst->timing = src->timing;
+    dst->pattern = src->pattern;
+    dst->phase_ms = src->phase_ms;
+}
+
+// A built-in effect, or the devicetree pattern for use when one is defined
+static void pixel_set_effect(struct led_pixel *pixel, int segment, enum color_index color,
+                             enum animation_type anim, enum led_pattern_use use) {
+    const struct led_pattern *pattern = led_pattern_for(use);
+
+    if (!pattern) {
+        pixel_set(pixel, color, MAX_BRIGHTNESS, anim, &fade_timing);
+        return;
+    }
+
+    memcpy(pixel->color, colors[color], 3);
+    pixel->brightness = MAX_BRIGHTNESS;
+    pixel->animation = ANIM_PATTERN;
+    pixel->pattern = pattern;
+    pixel->phase_ms = segment * pattern->segment_delay_ms;
+    pixel->set = true;
+}
+
+static bool role_booting(enum led_bar_role role) {
+    struct led_bar_role_state *state = &role_state[role];
+
+    if (state->boot_until > 0 && frame_time >= state->boot_until) {
+        state->boot_until = 0;
+    }
+    return state->boot_until > 0;
+}
+
+// The boot layer hides the statuses until it ends, they only count from then
+static void log_first_status(enum led_bar_role role) {
+    if (!first_status_shown && !role_booting(role)) {
+        first_status_shown = true;
+        LOG_INF("First status frame at %lld ms uptime", (long long)frame_time);
+    }
+}
+
+static bool render_connection(const struct led_bar *bar, struct led_pixel *pixels) {
+    if (role_state[BAR_ROLE_CONNECTION].expire_time == 0) return false;
+
+    log_first_status(BAR_ROLE_CONNECTION);
+    for (int i = 0; i < bar->num_segments; i++) {
+        if (i == system_state.active_profile) {
+            enum color_index color = system_state.connected ? COLOR_PROFILE_CONNECTED :
+                                    system_state.advertising ? COLOR_PROFILE_OPEN :
+                                    COLOR_PROFILE_PAIRED;
+
+            if (system_state.connected) {
+                pixel_set(&pixels[i], color, MAX_BRIGHTNESS, ANIM_FADE, &fade_timing);
+            } else {
+                pixel_set_effect(&pixels[i], i, color, ANIM_BREATH,
+                                 system_state.advertising ? PATTERN_ADVERTISING
+                                                          : PATTERN_DISCONNECTED);
+            }
+        } else {
+            pixel_set(&pixels[i], COLOR_BACKGROUND, MAX_BRIGHTNESS, ANIM_FADE, &fade_timing);
+        }
+    }
+    return true;
+}
+
+// Shift, ctrl, alt and GUI on the first four segments
+static bool render_modifiers(const struct led_bar *bar, struct led_pixel *pixels) {
+    if (!any_modifier_active() || system_state.activity == ZMK_ACTIVITY_SLEEP) return false;
+
+    for (int i = 0; i < MIN(bar->num_segments, MOD_SEGMENT_GUI + 1); i++) {
+        bool active = system_state.modifiers & BIT(i);
+        pixel_set(&pixels[i], COLOR_MODIFIER_ACTIVE, active ? MAX_BRIGHTNESS : 0,
+                  ANIM_FADE, &modifier_fade_timing);
+    }
+    return true;
+}
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_LAYER_INDICATOR
+// Layer N above the default one lights segment N-1, wrapping around the bar
+static bool render_keymap_layer(const struct led_bar *bar, struct led_pixel *pixels) {
+    if (system_state.keymap_layer == 0 || system_state.activity != ZMK_ACTIVITY_ACTIVE) return false;
+
+    pixel_set(&pixels[(system_state.keymap_layer - 1) % bar->num_segments], COLOR_LAYER_ACTIVE,
+              MAX_BRIGHTNESS, ANIM_FADE, &modifier_fade_timing);
+    return true;
+}
+#endif
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_LOCK_INDICATOR
+// Caps Lock on the last segment, Num Lock on the one before it
+static bool render_locks(const struct led_bar *bar, struct led_pixel *pixels) {
+    if (system_state.locks == 0 || system_state.activity != ZMK_ACTIVITY_ACTIVE) return false;
+
+    if (system_state.locks & LOCK_CAPS) {
+        pixel_set(&pixels[bar->num_segments - 1], COLOR_LOCK_ACTIVE, MAX_BRIGHTNESS, ANIM_FADE,
+                  &modifier_fade_timing);
+    }
+    if ((system_state.locks & LOCK_NUM) && bar->num_segments > 1) {
+        pixel_set(&pixels[bar->num_segments - 2], COLOR_LOCK_ACTIVE, MAX_BRIGHTNESS, ANIM_FADE,
+                  &modifier_fade_timing);
+    }
+    return true;
+}
+#endif
+
+static bool render_battery(const struct led_bar *bar, struct led_pixel *pixels) {
+    // dark until the first reading rather than showing an empty battery
+    if (role_state[BAR_ROLE_BATTERY].expire_time == 0 || !system_state.battery_valid) return false;
+
+    log_first_status(BAR_ROLE_BATTERY);
+    for (int i = 0; i < bar->num_segments; i++) {
+        if (bar->battery[i].animation == ANIM_BREATH) {
+            // only the segment being charged and a critical battery breathe
+            pixel_set_effect(&pixels[i], i, bar->battery[i].color, ANIM_BREATH,
+                             system_state.charging ? PATTERN_CHARGING : PATTERN_CRITICAL_BATTERY);
+        } else {
+            pixel_set(&pixels[i], bar->battery[i].color, MAX_BRIGHTNESS, bar->battery[i].animation,
+                      &fade_timing);
+        }
+    }
+    return true;
+}
+
+static bool battery_critical(void) {
+    return system_state.battery_valid &&
+           system_state.battery_percentage < led_settings[LED_SETTING_BATTERY_CRITICAL] &&
+           !system_state.charging;
+}
+
+// While idle, a critical battery flashes the first battery segment once per period
+// instead of breathing
+static bool heartbeat_on(void) {
+#if LED_IDLE_HEARTBEAT_MS > 0
+    int64_t elapsed = frame_time - system_state.idle_since;
+
+    return system_state.activity == ZMK_ACTIVITY_IDLE && battery_critical() &&
+           elapsed >= LED_IDLE_HEARTBEAT_MS && elapsed % LED_IDLE_HEARTBEAT_MS < LED_HEARTBEAT_ON_MS;
+#else
+    return false;
+#endif
+}
+
+static bool render_heartbeat(const struct led_bar *bar, struct led_pixel *pixels) {
+    if (!heartbeat_on()) return false;
+
+    pixel_set(&pixels[0], COLOR_BATTERY_RED, MAX_BRIGHTNESS, ANIM_FADE, &fade_timing);
+    return true;
+}
+
+// Staged fade-in, one segment per stage, toward the bar's far end when reversed.
+// Covers the whole bar so nothing below shows through until it ends, segments
+// whose stage hasn't started stay dark.
+static bool render_boot(const struct led_bar *bar, bool reversed, struct led_pixel *pixels) {
+    if (!role_booting(bar->role)) return false;
+
+    int stages = MIN((frame_time - boot_start) / LED_INIT_FADE_DURATION_MS + 1, bar->num_segments);
+    for (int stage = 0; stage < bar->num_segments; stage++) {
+        int idx = reversed ? bar->num_segments - 1 - stage : stage;
+        pixel_set(&pixels[idx], COLOR_BACKGROUND, stage < stages ? MAX_BRIGHTNESS : 0, ANIM_FADE,
+                  &init_fade_timing);
+    }
+    return true;
+}
+
+static bool render_boot_connection(const struct led_bar *bar, struct led_pixel *pixels) {
+    return render_boot(bar, true, pixels);
+}
+
+static bool render_boot_battery(const struct led_bar *bar, struct led_pixel *pixels) {
+    return render_boot(bar, false, pixels);
+}
+
+static const struct led_layer layers[] = {
+    [LAYER_MODIFIERS] = {BAR_ROLE_CONNECTION, 0xFF, render_modifiers},
+#ifdef CONFIG_VISORBEARER_LED_BAR_LAYER_INDICATOR
+    [LAYER_KEYMAP] = {BAR_ROLE_CONNECTION, 0xFF, render_keymap_layer},
+#endif
+#ifdef CONFIG_VISORBEARER_LED_BAR_LOCK_INDICATOR
+    [LAYER_LOCKS] = {BAR_ROLE_CONNECTION, 0xFF, render_locks},
+#endif
+    [LAYER_CONNECTION] = {BAR_ROLE_CONNECTION, 0xFF, render_connection},
+    [LAYER_BATTERY] = {BAR_ROLE_BATTERY, 0xFF, render_battery},
+    [LAYER_HEARTBEAT] = {BAR_ROLE_BATTERY, 0xFF, render_heartbeat},
+    [LAYER_BOOT_CONNECTION] = {BAR_ROLE_CONNECTION, 0xFF, render_boot_connection},
+    [LAYER_BOOT_BATTERY] = {BAR_ROLE_BATTERY, 0xFF, render_boot_battery},
+};
+
+// Blend the bar's layers into one frame and retarget only segments that changed
+static void bar_compose(struct led_bar *bar) {
+    struct led_pixel frame[LED_BAR_MAX_SEGMENTS] = {0};
+
+    for (size_t l = 0; l < ARRAY_SIZE(layers); l++) {
+        struct led_pixel pixels[LED_BAR_MAX_SEGMENTS] = {0};
+
+        if (layers[l].role != bar->role || !layers[l].render(bar, pixels)) continue;
+
+        for (int i = 0; i < bar->num_segments; i++) {
+            if (pixels[i].set) {
+                pixel_blend(&frame[i], &pixels[i], layers[l].opacity);
+            }
+        }
+    }
+
+    for (int i = 0; i < bar->num_segments; i++) {
+        struct led_segment *seg = &bar->segments[i];
+
+        if (frame[i].set && frame[i].animation == ANIM_PATTERN) {
+            segment_play(seg, frame[i].pattern, frame[i].color, frame[i].brightness,
+                         frame[i].phase_ms);
+        } else if (frame[i].set) {
+            segment_set(seg, frame[i].color, frame[i].brightness, frame[i].animation,
+                        frame[i].timing);
+        } else if (seg->target_brightness != 0) {
+            // nothing covers the segment any more, fade it out in its last color
+            segment_start_fade(seg, seg->color, 0, &fade_timing);
+        }
+    }
+}
+
+// Shortest frame interval any animating segment asks for, 0 when all are static
+static uint16_t bars_frame_interval(void) {
+    uint16_t interval = 0;
+
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        for (int i = 0; i < bars[b].num_segments; i++) {
+            uint16_t seg = segment_frame_interval(&bars[b].segments[i]);
+
+            if (seg > 0 && (interval == 0 || seg < interval)) interval = seg;
+        }
+    }
+    return interval;
+}
+
+
+static void deadline_min(int64_t *deadline, int64_t t) {
+    if (t > 0 && (*deadline == 0 || t < *deadline)) {
+        *deadline = t;
+    }
+}
+
+// Next time update_bars() has work to do without an event, 0 if none
+static int64_t next_deadline(void) {
+    int64_t deadline = 0;
+    bool booting = false;
+
+    for (int r = 0; r < NUM_BAR_ROLES; r++) {
+        deadline_min(&deadline, role_state[r].expire_time);
+        deadline_min(&deadline, role_state[r].boot_until);
+        booting |= role_state[r].boot_until > 0;
+    }
+
+    if (booting) {
+        int next_stage = (frame_time - boot_start) / LED_INIT_FADE_DURATION_MS + 1;
+        if (next_stage < (int)LED_BAR_MAX_SEGMENTS) {
+            deadline_min(&deadline, boot_start + next_stage * LED_INIT_FADE_DURATION_MS);
+        }
+    }
+
+#if LED_IDLE_HEARTBEAT_MS > 0
+    if (system_state.activity == ZMK_ACTIVITY_IDLE && battery_critical()) {
+        int64_t elapsed = frame_time - system_state.idle_since;
+        int64_t beat = system_state.idle_since + elapsed / LED_IDLE_HEARTBEAT_MS * LED_IDLE_HEARTBEAT_MS;
+
+        deadline_min(&deadline, heartbeat_on() ? beat + LED_HEARTBEAT_ON_MS
+                                               : beat + LED_IDLE_HEARTBEAT_MS);
+    }
+#endif
+
+    return deadline;
+}
+
+// Show a role's status on its bars for the event display time, ending any boot animation
+static void role_show(enum led_bar_role role) {
+    int64_t new_expire = frame_time + led_settings[LED_SETTING_EVENT_DISPLAY_MS];
+    if (role_state[role].expire_time < new_expire) {
+        role_state[role].expire_time = new_expire;
+    }
+    role_state[role].boot_until = 0;
+}
+
+// Cut a segment to dark right away
+static void segment_park(struct led_segment *seg) {
+    seg->brightness = 0;
+    seg->target_brightness = 0;
+    seg->pattern = NULL;
+    seg->dirty = true;
+}
+
+static void activity_changed(enum zmk_activity_state activity) {
+    if (activity == system_state.activity) return;
+
+    if (system_state.activity == ZMK_ACTIVITY_ACTIVE) {
+        // statuses shown when the keyboard went idle fade out now instead of at expiry
+        system_state.idle_since = frame_time;
+        for (int r = 0; r < NUM_BAR_ROLES; r++) {
+            role_state[r].expire_time = 0;
+            role_state[r].boot_until = 0;
+        }
+    }
+    if (activity == ZMK_ACTIVITY_SLEEP) {
+        // no fade, ZMK suspends the chips right after this frame
+        for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+            for (int i = 0; i < bars[b].num_segments; i++) {
+                segment_park(&bars[b].segments[i]);
+            }
+        }
+    }
+
+    LOG_DBG("Activity %d -> %d", system_state.activity, activity);
+    system_state.activity = activity;
+}
+
+// Whether the battery bars look different at level than at level - 1
+static bool battery_band_edge(uint8_t level) {
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        const struct led_bar *bar = &bars[b];
+
+        if (bar->role != BAR_ROLE_BATTERY) continue;
+
+        for (int i = 0; i < bar->num_segments; i++) {
+            struct battery_segment_config below = get_battery_segment_config(
+                i, bar->num_segments, level - 1, system_state.charging,
+                system_state.actively_charging);
+            struct battery_segment_config at = get_battery_segment_config(
+                i, bar->num_segments, level, system_state.charging,
+                system_state.actively_charging);
+
+            if (below.color != at.color || below.animation != at.animation) return true;
+        }
+    }
+    return false;
+}
+
+static bool battery_same_band(uint8_t a, uint8_t b) {
+    for (int edge = MIN(a, b) + 1; edge <= MAX(a, b); edge++) {
+        if (battery_band_edge(edge)) return false;
+    }
+    return true;
+}
+
+// Follow the reading within its band, but only cross into the next band once the
+// reading is BATTERY_HYSTERESIS past the edge. Stops at the last edge it may cross.
+static uint8_t battery_filter(uint8_t level, uint8_t raw) {
+    if (raw > level) {
+        for (int edge = level + 1; edge <= raw; edge++) {
+            if (raw < edge + BATTERY_HYSTERESIS && battery_band_edge(edge)) return edge - 1;
+        }
+    } else {
+        for (int edge = level; edge > raw; edge--) {
+            if (raw + BATTERY_HYSTERESIS >= edge && battery_band_edge(edge)) return edge;
+        }
+    }
+    return raw;
+}
+
+// Filter the last reading and work out the battery bars' looks again, only when the
+// band changed or refresh asks for it because charging or the thresholds did
+static void battery_update(bool refresh) {
+    uint8_t level;
+
+    if (!system_state.battery_valid) {
+        // zmk_battery_state_of_charge() reads 0 until the first sample
+        if (system_state.battery_raw == 0) return;
+        system_state.battery_valid = true;
+        level = system_state.battery_raw;
+        refresh = true;
+    } else {
+        level = battery_filter(system_state.battery_percentage, system_state.battery_raw);
+    }
+
+    if (level == system_state.battery_percentage && !refresh) return;
+
+    // within a band only the number changes, the segments look the same
+    bool crossed = !battery_same_band(level, system_state.battery_percentage);
+    system_state.battery_percentage = level;
+    if (!crossed && !refresh) return;
+
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        struct led_bar *bar = &bars[b];
+
+        if (bar->role != BAR_ROLE_BATTERY) continue;
+
+        for (int i = 0; i < bar->num_segments; i++) {
+            bar->battery[i] = get_battery_segment_config(i, bar->num_segments, level,
+                                                         system_state.charging,
+                                                         system_state.actively_charging);
+        }
+    }
+}
+
+// Take the settings posted since the last frame. Fades and breaths already
+// running keep their timing, the next ones use the new values.
+static void settings_apply(void) {
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        led_settings[i] = atomic_get(&settings_snapshot[i]);
+    }
+    fade_timing.duration_ms = led_settings[LED_SETTING_FADE_MS];
+    modifier_fade_timing.duration_ms = led_settings[LED_SETTING_MODIFIER_FADE_MS];
+
+    // the brightness cap changes every segment's duty without changing its level
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        for (int i = 0; i < bars[b].num_segments; i++) {
+            bars[b].segments[i].dirty = true;
+        }
+    }
+}
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+// Forget what the bars were showing, so a recording and its replay start out the
+// same: every segment dark with no color, no status up, the register images
+// rewritten in full and the next battery reading taken as is
+static void trace_origin_apply(void) {
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        for (int i = 0; i < bars[b].num_segments; i++) {
+            memset(&bars[b].segments[i], 0, sizeof(bars[b].segments[i]));
+            bars[b].segments[i].dirty = true;
+        }
+    }
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        chips[c].shadow_valid = false;
+    }
+    for (int r = 0; r < NUM_BAR_ROLES; r++) {
+        role_state[r].expire_time = 0;
+        role_state[r].boot_until = 0;
+    }
+    system_state.battery_valid = false;
+    system_state.battery_percentage = 0;
+}
+#endif
+
+// Apply every input posted since the last frame in one batch
+static void apply_inputs(void) {
+    atomic_val_t inputs = atomic_clear(&pending_inputs);
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+    // first, the inputs posted with it are the state to start from
+    if (inputs & BIT(LED_INPUT_TRACE_ORIGIN)) {
+        trace_origin_apply();
+    }
+#endif
+
+    if (inputs & BIT(LED_INPUT_BLE)) {
+        atomic_val_t ble = atomic_get(&ble_snapshot);
+        system_state.active_profile = ble & BLE_SNAPSHOT_PROFILE_MASK;
+        system_state.connected = (ble & BLE_SNAPSHOT_CONNECTED) != 0;
+        system_state.advertising = (ble & BLE_SNAPSHOT_ADVERTISING) != 0;
+    }
+    if (inputs & BIT(LED_INPUT_POWER)) {
+        system_state.charging = atomic_test_bit(&power_snapshot, POWER_SNAPSHOT_USB);
+        system_state.actively_charging = atomic_test_bit(&power_snapshot, POWER_SNAPSHOT_CHARGING);
+    }
+    if (inputs & BIT(LED_INPUT_BATTERY)) {
+        system_state.battery_raw = atomic_get(&battery_snapshot);
+    }
+    if (inputs & BIT(LED_INPUT_MODIFIERS)) {
+        system_state.modifiers = atomic_get(&modifier_snapshot);
+    }
+    if (inputs & BIT(LED_INPUT_KEYMAP_LAYER)) {
+        system_state.keymap_layer = atomic_get(&keymap_layer_snapshot);
+    }
+    if (inputs & BIT(LED_INPUT_LOCKS)) {
+        system_state.locks = atomic_get(&lock_snapshot);
+    }
+    if (inputs & BIT(LED_INPUT_RESET_STATS)) {
+        stats_reset();
+    }
+    if (inputs & BIT(LED_INPUT_ACTIVITY)) {
+        activity_changed(atomic_get(&activity_snapshot));
+    }
+    if (inputs & BIT(LED_INPUT_SETTINGS)) {
+        settings_apply();
+    }
+    // after the settings, the band edges depend on the battery thresholds
+    if (inputs & (BIT(LED_INPUT_POWER) | BIT(LED_INPUT_BATTERY) | BIT(LED_INPUT_SETTINGS))) {
+        // charging or thresholds changing restyle the bar even within a band
+        battery_update((inputs & (BIT(LED_INPUT_POWER) | BIT(LED_INPUT_SETTINGS))) != 0);
+    }
+    // nothing lights up again until the keyboard wakes
+    if (system_state.activity == ZMK_ACTIVITY_SLEEP) {
+        return;
+    }
+    if (inputs & BIT(LED_INPUT_SHOW_CONNECTION)) {
+        role_show(BAR_ROLE_CONNECTION);
+    }
+    if (inputs & BIT(LED_INPUT_SHOW_BATTERY)) {
+        role_show(BAR_ROLE_BATTERY);
+    }
+}
+
+static void publish_ble_state(void) {
+    bool connected = zmk_ble_active_profile_is_connected();
+    bool advertising = zmk_ble_active_profile_is_open() && !connected;
+
+    atomic_set(&ble_snapshot, (zmk_ble_active_profile_index() & BLE_SNAPSHOT_PROFILE_MASK) |
+                              (connected ? BLE_SNAPSHOT_CONNECTED : 0) |
+                              (advertising ? BLE_SNAPSHOT_ADVERTISING : 0));
+    post_input(LED_INPUT_BLE);
+}
+
+static void publish_battery_state(uint8_t state_of_charge) {
+    atomic_set(&battery_snapshot, state_of_charge);
+    post_input(LED_INPUT_BATTERY);
+}
+
+// Build every chip's image, hold the frame to the current budget and write it out
+static void flush_frame(void) {
+    struct chip_frame frames[ARRAY_SIZE(chips)];
+    struct led_chip *frame_chips[ARRAY_SIZE(chips)];
+    size_t count = 0;
+    uint32_t current_ua = 0;
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+    // segments stay dirty, the frame after this one catches up
+    if (!flush_wait_idle()) return;
+    flush_chain_len = 0;
+    flush_chain_pos = 0;
+    flush_wake = false;
+#endif
+
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        if (!chips[c].used) continue;
+
+        frame_chips[count] = &chips[c];
+        chip_build_frame(&chips[c], &frames[count]);
+        current_ua += chip_frame_current_ua(&chips[c], &frames[count]);
+        count++;
+    }
+
+#if LED_CURRENT_BUDGET_MA > 0
+    frames_limit_current(frame_chips, frames, count, current_ua);
+    current_ua = 0;
+    for (size_t c = 0; c < count; c++) {
+        current_ua += chip_frame_current_ua(frame_chips[c], &frames[c]);
+    }
+#endif
+
+    for (size_t c = 0; c < count; c++) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_BANK_MODE
+        chip_frame_bank(frame_chips[c], &frames[c]);
+#endif
+        chip_commit_frame(frame_chips[c], &frames[c]);
+    }
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+    // returns once the first transfer is queued, flush_idle_sem is given back at the end
+    flush_chain_next();
+#endif
+
+    // the previous frame's current flowed until now
+    led_stats.charge_ua_ms += (uint64_t)led_stats.current_ua * (frame_time - led_stats.current_since);
+    led_stats.current_ua = current_ua;
+    led_stats.current_since = frame_time;
+}
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_FRAME_COST_LOG
+struct frame_cost {
+    uint32_t bursts;
+    uint32_t bytes;
+    uint32_t cycles;
+};
+
+static void frame_cost_sample(struct frame_cost *cost) {
+    *cost = (struct frame_cost){.cycles = LED_FRAME_CYCLES()};
+
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        cost->bursts += chips[c].bursts_written;
+        cost->bytes += chips[c].bytes_written;
+    }
+}
+#endif
+
+static void update_bars(void) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_FRAME_COST_LOG
+    struct frame_cost start, end;
+    frame_cost_sample(&start);
+#endif
+
+    frame_time = k_uptime_get();
+
+    apply_inputs();
 
-    int64_t startup_expire = k_uptime_get() + LED_STARTUP_DISPLAY_TIME_MS;
-    conn_bar.expire_time = startup_expire;
-    batt_bar.expire_time = startup_expire;
+    // a modifier press ends the boot animation on the connection bars early
+    if (any_modifier_active()) {
+        role_state[BAR_ROLE_CONNECTION].boot_until = 0;
+    }
+
+    for (int r = 0; r < NUM_BAR_ROLES; r++) {
+        if (role_state[r].expire_time > 0 && frame_time >= role_state[r].expire_time) {
+            role_state[r].expire_time = 0;
+        }
+    }
+
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        bar_compose(&bars[b]);
+
+        for (int i = 0; i < bars[b].num_segments; i++) {
+            segment_update(&bars[b].segments[i]);
+        }
+    }
+
+    flush_frame();
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_FRAME_COST_LOG
+    frame_cost_sample(&end);
+    LOG_DBG("Frame %lld ms: %u bursts, %u bytes, %u us", (long long)frame_time,
+            end.bursts - start.bursts, end.bytes - start.bytes,
+            k_cyc_to_us_floor32(end.cycles - start.cycles));
+#endif
+}
+
+static void show_connection_status(void) {
+    post_input(LED_INPUT_SHOW_CONNECTION);
+}
+
+static void show_battery_status(void) {
+    post_input(LED_INPUT_SHOW_BATTERY);
+}
+
+static void update_modifier_state(uint8_t keycode, bool pressed) {
+    int segment = -1;
+
+    switch (keycode) {
+        case HID_USAGE_KEY_KEYBOARD_LEFTSHIFT:
+        case HID_USAGE_KEY_KEYBOARD_RIGHTSHIFT:
+            segment = MOD_SEGMENT_SHIFT;
+            break;
+        case HID_USAGE_KEY_KEYBOARD_LEFTCONTROL:
+        case HID_USAGE_KEY_KEYBOARD_RIGHTCONTROL:
+            segment = MOD_SEGMENT_CTRL;
+            break;
+        case HID_USAGE_KEY_KEYBOARD_LEFTALT:
+        case HID_USAGE_KEY_KEYBOARD_RIGHTALT:
+            segment = MOD_SEGMENT_ALT;
+            break;
+        case HID_USAGE_KEY_KEYBOARD_LEFT_GUI:
+        case HID_USAGE_KEY_KEYBOARD_RIGHT_GUI:
+            segment = MOD_SEGMENT_GUI;
+            break;
+    }
+
+    if (segment < 0) return;
+
+    // repeats of an already known state never wake the LED thread
+    bool was_pressed = pressed ? atomic_test_and_set_bit(&modifier_snapshot, segment)
+                               : atomic_test_and_clear_bit(&modifier_snapshot, segment);
+    if (was_pressed != pressed) {
+        post_input(LED_INPUT_MODIFIERS);
+    }
+}
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_LAYER_INDICATOR
+static void publish_keymap_layer(void) {
+    zmk_keymap_layer_id_t layer = zmk_keymap_highest_layer_active();
+    atomic_val_t shown = layer != zmk_keymap_layer_default() ? layer : 0;
+
+    // layer changes below the highest active one never wake the renderer
+    if (atomic_set(&keymap_layer_snapshot, shown) != shown) {
+        post_input(LED_INPUT_KEYMAP_LAYER);
+    }
+}
+#endif
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_LOCK_INDICATOR
+static void publish_locks(zmk_hid_indicators_t indicators) {
+    atomic_val_t locks = indicators & (LOCK_NUM | LOCK_CAPS);
+
+    // Scroll Lock and the other host LEDs are not shown
+    if (atomic_set(&lock_snapshot, locks) != locks) {
+        post_input(LED_INPUT_LOCKS);
+    }
+}
+#endif
+
+static bool skip_boot_animation(void) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_BOOT_ANIMATION_SKIP_ON_WARM_BOOT
+    uint32_t cause = 0;
+
+    if (hwinfo_get_reset_cause(&cause) < 0) {
+        return false;
+    }
+    // the reset reason accumulates across resets until cleared
+    hwinfo_clear_reset_cause();
+
+    return (cause & (RESET_SOFTWARE | RESET_LOW_POWER_WAKE)) != 0;
+#else
+    return false;
+#endif
+}
+
+// Match each bar to the chip driving it
+static int bars_attach(void) {
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        struct led_bar *bar = &bars[b];
+
+        for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+            if (chips[c].dev == bar->dev) {
+                bar->chip = &chips[c];
+            }
+        }
+        if (!bar->chip) {
+            LOG_ERR("%s is not a supported LP50xx", bar->dev->name);
+            return -ENOTSUP;
+        }
+        if (!device_is_ready(bar->dev)) {
+            LOG_ERR("LED device %s not ready", bar->dev->name);
+            return -ENODEV;
+        }
+
+        for (int i = 0; i < bar->num_segments; i++) {
+            if (bar->leds[i] >= bar->chip->max_leds) {
+                LOG_ERR("%s has no LED %d", bar->dev->name, bar->leds[i]);
+                return -EINVAL;
+            }
+            memset(&bar->segments[i], 0, sizeof(bar->segments[i]));
+            bar->segments[i].dirty = true;
+        }
+        bar->chip->used = true;
+    }
+    return 0;
+}
+
+static int led_init(void) {
+    int err = bars_attach();
+    if (err < 0) {
+        return err;
+    }
+
+    // config charging input pin
+    gpio0_dev = DEVICE_DT_GET(DT_NODELABEL(gpio0));
+    if (!device_is_ready(gpio0_dev)) {
+        LOG_ERR("GPIO0 device not ready");
+        return -ENODEV;
+    }
+    gpio_init_callback(&charge_status_cb, charge_status_changed, BIT(CHARGE_STATUS_PIN));
+    gpio_add_callback(gpio0_dev, &charge_status_cb);
+
+    // stored settings may have been loaded already, the renderer takes whatever is set now
+    post_input(LED_INPUT_SETTINGS);
+
+    publish_ble_state();
+    charge_detect_arm(zmk_usb_is_powered());
+
+    zmk_mod_flags_t mods = zmk_hid_get_explicit_mods();
+    atomic_set(&modifier_snapshot, ((mods & (MOD_LSFT | MOD_RSFT)) ? BIT(MOD_SEGMENT_SHIFT) : 0) |
+                                   ((mods & (MOD_LCTL | MOD_RCTL)) ? BIT(MOD_SEGMENT_CTRL) : 0) |
+                                   ((mods & (MOD_LALT | MOD_RALT)) ? BIT(MOD_SEGMENT_ALT) : 0) |
+                                   ((mods & (MOD_LGUI | MOD_RGUI)) ? BIT(MOD_SEGMENT_GUI) : 0));
+    post_input(LED_INPUT_MODIFIERS);
+#ifdef CONFIG_VISORBEARER_LED_BAR_LAYER_INDICATOR
+    publish_keymap_layer();
+#endif
+#ifdef CONFIG_VISORBEARER_LED_BAR_LOCK_INDICATOR
+    publish_locks(zmk_hid_indicators_get_current_profile());
+#endif
+
+    // 0 until the battery is first sampled, the battery bar then waits for
+    // the first battery_state_changed event instead
+    publish_battery_state(zmk_battery_state_of_charge());
+
+    frame_time = k_uptime_get();
+    apply_inputs();
+
+    // the boot animation is rendered by update_bars() like any other frame
+    boot_start = frame_time;
+    int64_t boot_end = boot_start;
+    if (!skip_boot_animation()) {
+        boot_end += LED_BAR_MAX_SEGMENTS * LED_INIT_FADE_DURATION_MS + LED_INIT_PAUSE_TIME_MS;
+    }
+    for (int r = 0; r < NUM_BAR_ROLES; r++) {
+        role_state[r].boot_until = boot_end;
+        role_state[r].expire_time = boot_end + LED_STARTUP_DISPLAY_TIME_MS;
+    }
 
     LOG_INF("LED initialized - Profile:%d Connected:%d Battery:%d%% Charging:%d",
             system_state.active_profile, system_state.connected,
@@ -539,24 +2553,126 @@ static int led_init(void) {
     return 0;
 }
 
+// Render one frame, returns when the next one is due or 0 when idle
+static int64_t render_frame(void) {
+    static bool was_animating;
+    uint32_t start = LED_FRAME_CYCLES();
+
+    update_bars();
+    stats_frame(LED_FRAME_CYCLES() - start);
+
+    int64_t deadline = next_deadline();
+    uint16_t interval = bars_frame_interval();
+
+    if (interval > 0) {
+        was_animating = true;
+        deadline_min(&deadline, frame_time + interval);
+    } else if (was_animating) {
+        was_animating = false;
+        for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+            if (chips[c].used) {
+                log_chip_stats(&chips[c]);
+            }
+        }
+        LOG_DBG("LEDs drew about %u uAh so far, %u uA now", led_charge_uah(), led_stats.current_ua);
+    }
+
+    if (system_state.activity == ZMK_ACTIVITY_SLEEP) {
+#ifdef CONFIG_VISORBEARER_LED_BAR_ASYNC_FLUSH
+        // the dark image has to be on the chips before ZMK suspends them
+        if (flush_wait_idle()) {
+            k_sem_give(&flush_idle_sem);
+        }
+#endif
+        k_sem_give(&led_parked_sem);
+    }
+
+    return deadline;
+}
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_RENDERER_WORKQUEUE
+static void render_work_handler(struct k_work *work) {
+    static bool initialized;
+
+    if (!initialized) {
+        led_init();
+        initialized = true;
+    }
+
+    // events never push frames faster than the highest frame rate
+    if (k_uptime_get() < frame_time + LED_FRAME_MIN_MS) {
+        k_work_reschedule(&render_work, K_TIMEOUT_ABS_MS(frame_time + LED_FRAME_MIN_MS));
+        return;
+    }
+
+    if (atomic_get(&pending_inputs) != 0) {
+        led_stats.event_wakeups++;
+    } else {
+        led_stats.timeout_wakeups++;
+    }
+
+    // nothing is queued while idle, the next event schedules the work again
+    int64_t deadline = render_frame();
+
+    // don't push back a wakeup for inputs posted while this frame rendered
+    if (atomic_get(&pending_inputs) != 0) {
+        deadline = frame_time + LED_FRAME_MIN_MS;
+    }
+    if (deadline > 0) {
+        k_work_reschedule(&render_work, K_TIMEOUT_ABS_MS(deadline));
+    }
+}
+
+static int led_renderer_start(void) {
+    k_work_schedule(&render_work, K_NO_WAIT);
+    return 0;
+}
+
+SYS_INIT(led_renderer_start, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#else
+// Let inputs that arrive right behind the first one join its frame, until the
+// window closes, an urgent input arrives or the next frame is due anyway
+static void coalesce_inputs(int64_t deadline) {
+    int64_t window_end = k_uptime_get() + LED_COALESCE_MS;
+
+    if (deadline > 0 && deadline < window_end) {
+        window_end = deadline;
+    }
+
+    while (!(atomic_get(&pending_inputs) & LED_URGENT_INPUTS) &&
+           k_sem_take(&led_update_sem, K_TIMEOUT_ABS_MS(window_end)) == 0) {
+    }
+}
+
 static void led_thread(void *arg1, void *arg2, void *arg3) {
     led_init();
 
     while (1) {
-        update_bars();
+        int64_t deadline = render_frame();
 
-        if (bars_animating()) {
-            k_sleep(K_MSEC(10));
+        // sleep until an event arrives or the next deadline, never poll
+        if (k_sem_take(&led_update_sem,
+                       deadline > 0 ? K_TIMEOUT_ABS_MS(deadline) : K_FOREVER) == 0) {
+            led_stats.event_wakeups++;
+            coalesce_inputs(deadline);
         } else {
-            k_sem_take(&led_update_sem, K_MSEC(100));
+            led_stats.timeout_wakeups++;
+        }
+
+        // events never push frames faster than the highest frame rate
+        if (k_uptime_get() < frame_time + LED_FRAME_MIN_MS) {
+            k_sleep(K_TIMEOUT_ABS_MS(frame_time + LED_FRAME_MIN_MS));
         }
     }
 }
 
+K_THREAD_DEFINE(led_thread_id, CONFIG_VISORBEARER_LED_BAR_THREAD_STACK_SIZE, led_thread,
+                NULL, NULL, NULL, K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+#endif
+
 static int ble_profile_changed_listener(const zmk_event_t *eh) {
-    system_state.active_profile = zmk_ble_active_profile_index();
-    update_ble_state();
-    LOG_INF("Profile changed to %d", system_state.active_profile);
+    publish_ble_state();
+    LOG_INF("Profile changed to %d", zmk_ble_active_profile_index());
     show_connection_status();
     return ZMK_EV_EVENT_BUBBLE;
 }
@@ -564,16 +2680,48 @@ static int ble_profile_changed_listener(const zmk_event_t *eh) {
 ZMK_LISTENER(led_bar, ble_profile_changed_listener);
 ZMK_SUBSCRIPTION(led_bar, zmk_ble_active_profile_changed);
 
+// Darken the bars before ZMK suspends devices for sleep, the renderer then
+// stays blocked until the next input
+static void renderer_park(void) {
+    k_sem_reset(&led_parked_sem);
+    post_input(LED_INPUT_ACTIVITY);
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_RENDERER_WORKQUEUE
+    if (k_current_get() == k_work_queue_thread_get(&k_sys_work_q)) {
+        // the render work can't run while this handler does, park from here
+        k_work_cancel_delayable(&render_work);
+        render_frame();
+        return;
+    }
+#endif
+
+    if (k_sem_take(&led_parked_sem, K_MSEC(LED_PARK_TIMEOUT_MS)) < 0) {
+        LOG_WRN("LED renderer did not park before sleep");
+    }
+}
+
 static int activity_state_changed_listener(const zmk_event_t *eh) {
     const struct zmk_activity_state_changed *event = as_zmk_activity_state_changed(eh);
-    if (event && event->state == ZMK_ACTIVITY_ACTIVE) {
-        update_ble_state();
+    if (!event) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    atomic_set(&activity_snapshot, event->state);
+    if (event->state == ZMK_ACTIVITY_SLEEP) {
+        renderer_park();
+    } else {
+        post_input(LED_INPUT_ACTIVITY);
+    }
+
+    if (event->state == ZMK_ACTIVITY_ACTIVE) {
+        publish_ble_state();
 
         // show status for disconnected profile (when endpoint is BLE) or critical battery
-        if (!system_state.connected && zmk_endpoints_selected().transport == ZMK_TRANSPORT_BLE) {
+        if (!zmk_ble_active_profile_is_connected() &&
+            zmk_endpoints_selected().transport == ZMK_TRANSPORT_BLE) {
             show_connection_status();
         }
-        if (system_state.battery_percentage < BATTERY_CRITICAL_THRESHOLD) {
+        if (atomic_get(&battery_snapshot) < led_setting_get(LED_SETTING_BATTERY_CRITICAL)) {
             show_battery_status();
         }
     }
@@ -584,10 +2732,9 @@ ZMK_LISTENER(led_activity, activity_state_changed_listener);
 ZMK_SUBSCRIPTION(led_activity, zmk_activity_state_changed);
 
 static int usb_conn_state_changed_listener(const zmk_event_t *eh) {
-    system_state.charging = zmk_usb_is_powered();
-    system_state.actively_charging = is_actively_charging();
-    system_state.last_charging_check = k_uptime_get();
-    LOG_INF("USB state changed - charging: %d", system_state.charging);
+    bool usb_powered = zmk_usb_is_powered();
+    charge_detect_arm(usb_powered);
+    LOG_INF("USB state changed - charging: %d", usb_powered);
     show_battery_status();
     return ZMK_EV_EVENT_BUBBLE;
 }
@@ -598,9 +2745,9 @@ ZMK_SUBSCRIPTION(led_usb, zmk_usb_conn_state_changed);
 static int battery_state_changed_listener(const zmk_event_t *eh) {
     const struct zmk_battery_state_changed *event = as_zmk_battery_state_changed(eh);
     if (event) {
-        system_state.battery_percentage = event->state_of_charge;
+        publish_battery_state(event->state_of_charge);
         // Show battery bar if critical
-        if (system_state.battery_percentage < BATTERY_CRITICAL_THRESHOLD) {
+        if (event->state_of_charge < led_setting_get(LED_SETTING_BATTERY_CRITICAL)) {
             show_battery_status();
         }
     }
@@ -621,8 +2768,28 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
 ZMK_LISTENER(led_keycode, keycode_state_changed_listener);
 ZMK_SUBSCRIPTION(led_keycode, zmk_keycode_state_changed);
 
-K_THREAD_DEFINE(led_thread_id, 1024, led_thread, NULL, NULL, NULL,
-                K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+#ifdef CONFIG_VISORBEARER_LED_BAR_LAYER_INDICATOR
+static int layer_state_changed_listener(const zmk_event_t *eh) {
+    publish_keymap_layer();
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(led_layer, layer_state_changed_listener);
+ZMK_SUBSCRIPTION(led_layer, zmk_layer_state_changed);
+#endif
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_LOCK_INDICATOR
+static int hid_indicators_changed_listener(const zmk_event_t *eh) {
+    const struct zmk_hid_indicators_changed *event = as_zmk_hid_indicators_changed(eh);
+    if (event) {
+        publish_locks(event->indicators);
+    }
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(led_hid_indicators, hid_indicators_changed_listener);
+ZMK_SUBSCRIPTION(led_hid_indicators, zmk_hid_indicators_changed);
+#endif
 
 void led_show_ble_status(void) {
     show_connection_status();
@@ -630,4 +2797,335 @@ void led_show_ble_status(void) {
 
 void led_show_battery_status(void) {
     show_battery_status();
-}
\ No newline at end of file
+}
+#ifdef CONFIG_VISORBEARER_LED_BAR_SHELL
+static const char *const animation_names[NUM_ANIMATION_TYPES] = {
+    [ANIM_NONE] = "static",
+    [ANIM_FADE] = "fade",
+    [ANIM_BREATH] = "breath",
+    [ANIM_PATTERN] = "pattern",
+};
+
+// Counters are read while the renderer runs, a line may mix two frames
+static int cmd_led_stats(const struct shell *sh, size_t argc, char **argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "reset") != 0) {
+            shell_error(sh, "Unknown argument: %s", argv[1]);
+            return -EINVAL;
+        }
+        // the renderer owns the counters, let it clear them on its next frame
+        post_input(LED_INPUT_RESET_STATS);
+        shell_print(sh, "LED stats reset");
+        return 0;
+    }
+
+    uint32_t frames = led_stats.frames;
+
+    shell_print(sh, "frames: %u", frames);
+    for (int a = 0; a < NUM_ANIMATION_TYPES; a++) {
+        shell_print(sh, "  %s: %u", animation_names[a], led_stats.anim_frames[a]);
+    }
+    shell_print(sh, "wakeups: %u event, %u timeout", led_stats.event_wakeups,
+                led_stats.timeout_wakeups);
+    shell_print(sh, "update_bars: %llu us total, %u us avg, %u us max",
+                (unsigned long long)k_cyc_to_us_floor64(led_stats.update_cycles),
+                frames ? (uint32_t)k_cyc_to_us_floor64(led_stats.update_cycles / frames) : 0,
+                k_cyc_to_us_floor32(led_stats.update_cycles_max));
+
+    shell_print(sh, "LED current: %u uA now, %u uAh this session", led_stats.current_ua,
+                led_charge_uah());
+#if LED_CURRENT_BUDGET_MA > 0
+    shell_print(sh, "current budget: %u uA at %u%% battery", current_budget_ua(),
+                system_state.battery_percentage);
+#endif
+
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        const struct led_chip *chip = &chips[c];
+
+        if (!chip->used) continue;
+        shell_print(sh, "%s: %u writes (%u bytes), %u failed, %u skipped, %u banked frames, "
+                    "powered %lld ms%s",
+                    chip->dev->name, chip->bursts_written, chip->bytes_written,
+                    chip->write_errors, chip->bursts_skipped, chip->bank_frames,
+                    (long long)chip_powered_ms(chip),
+                    chip->powered ? " (on)" : "");
+    }
+    return 0;
+}
+
+SHELL_SUBCMD_ADD((visorbearer, led), stats, NULL,
+                 "Print LED renderer counters, \"reset\" clears them", cmd_led_stats, 1, 1);
+
+static int cmd_led_get(const struct shell *sh, size_t argc, char **argv) {
+    bool found = false;
+
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        const struct led_setting_info *info = &setting_info[i];
+
+        if (argc > 1 && strcmp(argv[1], info->name) != 0) continue;
+        shell_print(sh, "%s: %d (%u-%u, default %u)", info->name, led_setting_get(i), info->min,
+                    info->max, setting_defaults[i]);
+        found = true;
+    }
+
+    if (!found) {
+        shell_error(sh, "Unknown setting: %s", argv[1]);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int cmd_led_set(const struct shell *sh, size_t argc, char **argv) {
+    char *end;
+    long value = strtol(argv[2], &end, 10);
+
+    if (end == argv[2] || *end != '\0') {
+        shell_error(sh, "Invalid value: %s", argv[2]);
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        if (strcmp(argv[1], setting_info[i].name) == 0) {
+            shell_print(sh, "%s: %d", setting_info[i].name, led_setting_set(i, value));
+            return 0;
+        }
+    }
+
+    shell_error(sh, "Unknown setting: %s", argv[1]);
+    return -EINVAL;
+}
+
+static int cmd_led_defaults(const struct shell *sh, size_t argc, char **argv) {
+    led_settings_reset();
+    shell_print(sh, "LED settings restored to their defaults");
+    return 0;
+}
+
+SHELL_SUBCMD_ADD((visorbearer, led), get, NULL, "Print the LED settings, or the named one",
+                 cmd_led_get, 1, 1);
+SHELL_SUBCMD_ADD((visorbearer, led), set, NULL, "Change an LED setting: set <name> <value>",
+                 cmd_led_set, 3, 0);
+SHELL_SUBCMD_ADD((visorbearer, led), defaults, NULL, "Restore every LED setting to its default",
+                 cmd_led_defaults, 1, 0);
+
+#ifdef CONFIG_VISORBEARER_LED_BAR_TRACE
+static const char *const trace_event_names[NUM_LED_INPUTS] = {
+    [LED_INPUT_BLE] = "ble",
+    [LED_INPUT_POWER] = "power",
+    [LED_INPUT_BATTERY] = "battery",
+    [LED_INPUT_MODIFIERS] = "modifiers",
+    [LED_INPUT_SHOW_CONNECTION] = "show-connection",
+    [LED_INPUT_SHOW_BATTERY] = "show-battery",
+    [LED_INPUT_RESET_STATS] = "reset-stats",
+    [LED_INPUT_ACTIVITY] = "activity",
+    [LED_INPUT_SETTINGS] = "settings",
+    [LED_INPUT_KEYMAP_LAYER] = "keymap-layer",
+    [LED_INPUT_LOCKS] = "locks",
+    [LED_INPUT_TRACE_ORIGIN] = "trace-origin",
+};
+
+static const char *trace_event_name(uint8_t event) {
+    switch (event) {
+        case LED_TRACE_SETTING:
+            return "setting";
+        case LED_TRACE_CHARGE_READ:
+            return "charge-read";
+        default:
+            return event < NUM_LED_INPUTS ? trace_event_names[event] : "?";
+    }
+}
+
+// One line per origin snapshot and setting, then one per entry:
+// "<ms> [origin] <event> 0x<value> [<setting>]"
+static int cmd_led_trace_dump(const struct shell *sh, size_t argc, char **argv) {
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    size_t count = trace_count;
+    uint32_t origin_ms = trace_origin.time_ms;
+    k_spin_unlock(&trace_lock, key);
+
+    for (int i = 0; i < NUM_LED_INPUTS; i++) {
+        if (input_snapshots[i]) {
+            shell_print(sh, "%10u origin %-16s 0x%04x", origin_ms, trace_event_names[i],
+                        trace_origin.inputs[i]);
+        }
+    }
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        shell_print(sh, "%10u origin %-16s 0x%04x %s", origin_ms, "setting",
+                    trace_origin.settings[i], setting_info[i].name);
+    }
+
+    // entries recorded while printing may overwrite the oldest lines
+    for (size_t i = 0; i < count; i++) {
+        const struct led_trace_entry *entry = trace_entry(i);
+
+        if (entry->event == LED_TRACE_SETTING) {
+            shell_print(sh, "%10u %-16s 0x%04x %s", entry->time_ms, "setting", entry->value,
+                        setting_info[entry->arg].name);
+        } else {
+            shell_print(sh, "%10u %-16s 0x%04x", entry->time_ms, trace_event_name(entry->event),
+                        entry->value);
+        }
+    }
+    shell_print(sh, "%u entries", (unsigned int)count);
+    return 0;
+}
+
+// Start a new recording from what the renderer is being fed now
+static int trace_clear(void) {
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    bool busy = trace_replaying;
+    if (!busy) {
+        trace_head = 0;
+        trace_count = 0;
+        trace_origin.time_ms = k_uptime_get_32();
+        for (int i = 0; i < NUM_LED_INPUTS; i++) {
+            trace_origin.inputs[i] = input_snapshot(i);
+        }
+        for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+            trace_origin.settings[i] = atomic_get(&settings_snapshot[i]);
+        }
+    }
+    k_spin_unlock(&trace_lock, key);
+
+    if (busy) {
+        return -EBUSY;
+    }
+    trace_origin_post();
+    return 0;
+}
+
+static int cmd_led_trace_clear(const struct shell *sh, size_t argc, char **argv) {
+    int err = trace_clear();
+    if (err == -EBUSY) {
+        shell_error(sh, "Replay running");
+    }
+    return err;
+}
+
+static void trace_replay_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(trace_replay_work, trace_replay_handler);
+static size_t replay_pos;
+static int64_t replay_start;
+
+// Hand the settings back to the user: the ones from before the replay with any
+// changes made during it. Under settings_lock throughout so no change slips in
+// between, the settings input is posted before recording resumes.
+static void trace_replay_finish(void) {
+    bool changed = false;
+    k_spinlock_key_t key = k_spin_lock(&settings_lock);
+
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        if (atomic_get(&settings_snapshot[i]) != replay_saved_settings[i]) {
+            atomic_set(&settings_snapshot[i], replay_saved_settings[i]);
+            changed = true;
+        }
+    }
+    if (changed) {
+        post_input(LED_INPUT_SETTINGS);
+    }
+
+    k_spinlock_key_t trace_key = k_spin_lock(&trace_lock);
+    trace_replaying = false;
+    k_spin_unlock(&trace_lock, trace_key);
+
+    k_spin_unlock(&settings_lock, key);
+    LOG_INF("Trace replay done");
+}
+
+// Feed the recorded inputs back at their offsets from the origin
+static void trace_replay_handler(struct k_work *work) {
+    for (; replay_pos < trace_count; replay_pos++) {
+        const struct led_trace_entry *entry = trace_entry(replay_pos);
+        int64_t due = replay_start + (entry->time_ms - trace_origin.time_ms);
+
+        if (k_uptime_get() < due) {
+            k_work_schedule(&trace_replay_work, K_TIMEOUT_ABS_MS(due));
+            return;
+        }
+
+        if (entry->event == LED_TRACE_SETTING) {
+            // takes effect with the settings input that follows it
+            atomic_set(&settings_snapshot[entry->arg], entry->value);
+            continue;
+        }
+        // pin reads only explain the power inputs that follow them, and the stats
+        // are the bench's own
+        if (entry->event >= NUM_LED_INPUTS || entry->event == LED_INPUT_RESET_STATS) {
+            continue;
+        }
+        if (input_snapshots[entry->event]) {
+            atomic_set(input_snapshots[entry->event], entry->value);
+        }
+        post_input(entry->event);
+    }
+
+    trace_replay_finish();
+}
+
+// Restore the origin and replay the entries from now on, recording pauses meanwhile.
+// The live settings follow the trace, what is saved and changed by the user are
+// the ones from before it.
+static int trace_replay_start(void) {
+    k_spinlock_key_t key = k_spin_lock(&settings_lock);
+    k_spinlock_key_t trace_key = k_spin_lock(&trace_lock);
+    bool busy = trace_replaying;
+    bool empty = trace_count == 0;
+    if (!busy && !empty) {
+        for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+            replay_saved_settings[i] = atomic_get(&settings_snapshot[i]);
+        }
+        trace_replaying = true;
+    }
+    k_spin_unlock(&trace_lock, trace_key);
+    k_spin_unlock(&settings_lock, key);
+
+    if (busy) {
+        return -EBUSY;
+    }
+    if (empty) {
+        return -ENOENT;
+    }
+
+    replay_pos = 0;
+    replay_start = k_uptime_get();
+    trace_origin_post();
+    k_work_schedule(&trace_replay_work, K_NO_WAIT);
+    return 0;
+}
+
+static int cmd_led_trace_replay(const struct shell *sh, size_t argc, char **argv) {
+    int err = trace_replay_start();
+    if (err == -EBUSY) {
+        shell_error(sh, "Replay already running");
+        return err;
+    }
+    if (err == -ENOENT) {
+        shell_error(sh, "Nothing to replay");
+        return err;
+    }
+
+    shell_print(sh, "Replaying %u entries over %u ms", (unsigned int)trace_count,
+                trace_entry(trace_count - 1)->time_ms - trace_origin.time_ms);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_visorbearer_led_trace,
+    SHELL_CMD(dump, NULL, "Print recorded inputs, oldest first", cmd_led_trace_dump),
+    SHELL_CMD(clear, NULL, "Start a new trace from the current state, the bars go dark",
+              cmd_led_trace_clear),
+    SHELL_CMD(replay, NULL, "Restore the trace origin and post the recorded inputs again",
+              cmd_led_trace_replay),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((visorbearer, led), trace, &sub_visorbearer_led_trace,
+                 "Renderer input trace", NULL, 1, 0);
+#endif
+
+SHELL_SUBCMD_SET_CREATE(sub_visorbearer_led, (visorbearer, led));
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_visorbearer,
+    SHELL_CMD(led, &sub_visorbearer_led, "LED bar commands", NULL),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(visorbearer, &sub_visorbearer, "Visorbearer commands", NULL);
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+
+int zmk_ble_active_profile_index(void);
+bool zmk_ble_active_profile_is_connected(void);
+bool zmk_ble_active_profile_is_open(void);
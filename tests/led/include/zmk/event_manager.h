@@ -0,0 +1,62 @@
+#pragma once
+
+// Stand-in for ZMK's event manager in the host tests. raise_<event>() runs every
+// subscribed listener right away in the raising thread, in link order.
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/iterable_sections.h>
+
+struct zmk_event_type {
+    const char *name;
+};
+
+typedef struct {
+    const struct zmk_event_type *event;
+    uint8_t last_listener_index;
+} zmk_event_t;
+
+#define ZMK_EV_EVENT_BUBBLE 0
+#define ZMK_EV_EVENT_HANDLED 1
+#define ZMK_EV_EVENT_CAPTURED 2
+
+typedef int (*zmk_listener_callback_t)(const zmk_event_t *eh);
+
+struct zmk_listener {
+    zmk_listener_callback_t callback;
+};
+
+struct zmk_event_subscription {
+    const struct zmk_event_type *event_type;
+    const struct zmk_listener *listener;
+};
+
+int zmk_event_manager_raise(zmk_event_t *event);
+
+#define ZMK_EVENT_DECLARE(event_type)                                                        \
+    struct event_type##_event {                                                              \
+        zmk_event_t header;                                                                  \
+        struct event_type data;                                                              \
+    };                                                                                       \
+    extern const struct zmk_event_type zmk_event_##event_type;                               \
+    static inline struct event_type *as_##event_type(const zmk_event_t *eh) {                \
+        return eh->event == &zmk_event_##event_type ? &((struct event_type##_event *)eh)->data \
+                                                    : NULL;                                  \
+    }                                                                                        \
+    static inline int raise_##event_type(struct event_type data) {                           \
+        struct event_type##_event ev = {                                                     \
+            .header = {.event = &zmk_event_##event_type},                                    \
+            .data = data,                                                                    \
+        };                                                                                   \
+        return zmk_event_manager_raise(&ev.header);                                          \
+    }
+
+#define ZMK_EVENT_IMPL(event_type)                                                           \
+    const struct zmk_event_type zmk_event_##event_type = {.name = STRINGIFY(event_type)};
+
+#define ZMK_LISTENER(mod, cb) const struct zmk_listener zmk_listener_##mod = {.callback = cb};
+
+#define ZMK_SUBSCRIPTION(mod, ev_type)                                                       \
+    const STRUCT_SECTION_ITERABLE(zmk_event_subscription, zmk_event_sub_##mod##_##ev_type) = { \
+        .event_type = &zmk_event_##ev_type,                                                  \
+        .listener = &zmk_listener_##mod,                                                     \
+    };
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <zmk/event_manager.h>
+#include <zmk/hid_indicators.h>
+
+struct zmk_hid_indicators_changed {
+    zmk_hid_indicators_t indicators;
+};
+
+ZMK_EVENT_DECLARE(zmk_hid_indicators_changed);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+// The subset of ZMK's HID usages and modifier flags the LED renderer uses
+#define HID_USAGE_KEY 0x07
+#define HID_USAGE_KEY_KEYBOARD_LEFTCONTROL 0xE0
+#define HID_USAGE_KEY_KEYBOARD_LEFTSHIFT 0xE1
+#define HID_USAGE_KEY_KEYBOARD_LEFTALT 0xE2
+#define HID_USAGE_KEY_KEYBOARD_LEFT_GUI 0xE3
+#define HID_USAGE_KEY_KEYBOARD_RIGHTCONTROL 0xE4
+#define HID_USAGE_KEY_KEYBOARD_RIGHTSHIFT 0xE5
+#define HID_USAGE_KEY_KEYBOARD_RIGHTALT 0xE6
+#define HID_USAGE_KEY_KEYBOARD_RIGHT_GUI 0xE7
+
+#define MOD_LCTL BIT(0)
+#define MOD_LSFT BIT(1)
+#define MOD_LALT BIT(2)
+#define MOD_LGUI BIT(3)
+#define MOD_RCTL BIT(4)
+#define MOD_RSFT BIT(5)
+#define MOD_RALT BIT(6)
+#define MOD_RGUI BIT(7)
+
+typedef uint8_t zmk_mod_flags_t;
+
+static inline bool is_mod(uint16_t usage_page, uint32_t keycode) {
+    return usage_page == HID_USAGE_KEY && keycode >= HID_USAGE_KEY_KEYBOARD_LEFTCONTROL &&
+           keycode <= HID_USAGE_KEY_KEYBOARD_RIGHT_GUI;
+}
+
+zmk_mod_flags_t zmk_hid_get_explicit_mods(void);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef uint8_t zmk_hid_indicators_t;
+
+zmk_hid_indicators_t zmk_hid_indicators_get_current_profile(void);
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef uint8_t zmk_keymap_layer_id_t;
+
+zmk_keymap_layer_id_t zmk_keymap_highest_layer_active(void);
+zmk_keymap_layer_id_t zmk_keymap_layer_default(void);
@@ -0,0 +1,85 @@
+// Samples the bars through the boot animation. ztest runs suites in name order,
+// this one has to come first to see the renderer from power-on.
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "led_under_test.h"
+#include "scenario.h"
+
+// Same as app.overlay
+#define BAR_SEGMENTS 4
+
+#define SAMPLE_MS 5
+
+static const uint8_t color_background[3] = {0x08, 0x08, 0x08};
+
+static const int roles[] = {LED_TEST_ROLE_CONNECTION, LED_TEST_ROLE_BATTERY};
+
+// Count the segments the boot fade has lit, the others have to be dark
+static void boot_count_lit(int role, int *lit) {
+    *lit = 0;
+
+    for (int i = 0; i < BAR_SEGMENTS; i++) {
+        struct led_test_segment seg;
+
+        zassert_ok(led_test_segment_get(role, i, &seg));
+        zassert_false(seg.breathing, "role %d segment %d breathes during boot", role, i);
+        if (seg.target_brightness == 0) continue;
+
+        zassert_mem_equal(seg.target_color, color_background, 3,
+                          "role %d segment %d shows a status during boot", role, i);
+        (*lit)++;
+    }
+}
+
+ZTEST(boot, test_boot_owns_the_bars) {
+    int lit[ARRAY_SIZE(roles)] = {0};
+    int64_t start;
+    int64_t until;
+
+    // the renderer runs led_init() as soon as this thread sleeps
+    k_sleep(K_MSEC(1));
+    led_test_boot_window(LED_TEST_ROLE_CONNECTION, &start, &until);
+    zassert_true(until > k_uptime_get(), "boot animation over before the suite ran");
+
+    while (k_uptime_get() < until - SAMPLE_MS) {
+        for (size_t r = 0; r < ARRAY_SIZE(roles); r++) {
+            int now;
+
+            boot_count_lit(roles[r], &now);
+
+            // one more segment per stage, never one less
+            zassert_true(now >= lit[r], "role %d went from %d to %d lit segments", roles[r],
+                         lit[r], now);
+            lit[r] = now;
+        }
+        k_sleep(K_MSEC(SAMPLE_MS));
+    }
+    for (size_t r = 0; r < ARRAY_SIZE(roles); r++) {
+        zassert_equal(lit[r], BAR_SEGMENTS, "role %d ended boot with %d segments lit", roles[r],
+                      lit[r]);
+    }
+
+    // the startup status takes over once the animation ends
+    k_sleep(K_MSEC(until - k_uptime_get() + 2 * SAMPLE_MS));
+    led_test_boot_window(LED_TEST_ROLE_CONNECTION, &start, &until);
+    zassert_equal(until, 0, "boot animation did not end");
+    zassert_true(led_test_role_shown(LED_TEST_ROLE_CONNECTION));
+
+    struct led_test_segment seg;
+    zassert_ok(led_test_segment_get(LED_TEST_ROLE_CONNECTION, 0, &seg));
+    zassert_true(memcmp(seg.target_color, color_background, 3) != 0,
+                 "active profile not shown after boot");
+
+    // nothing reset the counters yet, they cover power-on up to here
+    struct scenario_cost cost;
+
+    cost_get(&cost);
+    cost_report("boot", &cost);
+    zassert_equal(cost.led.write_errors, 0, "%u LP50xx writes failed", cost.led.write_errors);
+}
+
+ZTEST_SUITE(boot, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,13 @@
+// Built into the native simulator runner, where the host C library is available
+
+#include <stdint.h>
+#include <time.h>
+
+// CPU time the calling host thread has used. Every Zephyr thread of native_sim
+// runs on its own host thread, so this excludes time spent in other threads.
+uint64_t led_test_host_cpu_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
@@ -0,0 +1,210 @@
+// The renderer under test, built as one unit with the accessors the tests use
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t led_test_host_cpu_ns(void);
+
+#define LED_FRAME_CYCLES() ((uint32_t)led_test_host_cpu_ns())
+
+#include "../../../src/led.c"
+
+#include "led_under_test.h"
+
+BUILD_ASSERT(LED_TEST_ROLE_CONNECTION == BAR_ROLE_CONNECTION &&
+             LED_TEST_ROLE_BATTERY == BAR_ROLE_BATTERY);
+BUILD_ASSERT(LED_TEST_IMAGE_FIRST_REG == LP50XX_LED_CONFIG0);
+
+void led_test_cost_get(struct led_test_cost *cost) {
+    *cost = (struct led_test_cost){
+        .frames = led_stats.frames,
+        .event_wakeups = led_stats.event_wakeups,
+        .timeout_wakeups = led_stats.timeout_wakeups,
+        .update_ns = led_stats.update_cycles,
+        .update_ns_max = led_stats.update_cycles_max,
+    };
+
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        cost->bursts += chips[c].bursts_written;
+        cost->bytes += chips[c].bytes_written;
+        cost->write_errors += chips[c].write_errors;
+    }
+}
+
+void led_test_cost_reset(void) {
+    stats_reset();
+}
+
+int led_test_segment_get(int role, int segment, struct led_test_segment *out) {
+    for (size_t b = 0; b < ARRAY_SIZE(bars); b++) {
+        const struct led_segment *seg;
+
+        if ((int)bars[b].role != role) continue;
+        if (segment >= bars[b].num_segments) {
+            return -EINVAL;
+        }
+
+        seg = &bars[b].segments[segment];
+        memcpy(out->target_color, seg->target_color, sizeof(out->target_color));
+        out->brightness = seg->brightness;
+        out->target_brightness = seg->target_brightness;
+        out->animating = segment_animating(seg);
+        out->breathing = out->animating && seg->pattern->loop;
+        return 0;
+    }
+    return -ENOENT;
+}
+
+bool led_test_role_shown(int role) {
+    return role_state[role].expire_time > 0;
+}
+
+void led_test_boot_window(int role, int64_t *start, int64_t *until) {
+    *start = boot_start;
+    *until = role_state[role].boot_until;
+}
+
+uint8_t led_test_battery_level(void) {
+    return system_state.battery_percentage;
+}
+
+bool led_test_charging(void) {
+    return system_state.charging;
+}
+
+bool led_test_actively_charging(void) {
+    return system_state.actively_charging;
+}
+
+int led_test_chip_image(const struct device *dev, const uint8_t **image, size_t *len) {
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        if (chips[c].dev != dev) continue;
+        if (!chips[c].shadow_valid) {
+            return -ENODATA;
+        }
+
+        *image = chips[c].shadow;
+        *len = LP50XX_CHANNELS(chips[c].max_leds);
+        return 0;
+    }
+    return -ENOENT;
+}
+
+static int trace_event_parse(const char *name) {
+    if (strcmp(name, "setting") == 0) return LED_TRACE_SETTING;
+    if (strcmp(name, "charge-read") == 0) return LED_TRACE_CHARGE_READ;
+
+    for (int i = 0; i < NUM_LED_INPUTS; i++) {
+        if (trace_event_names[i] && strcmp(name, trace_event_names[i]) == 0) return i;
+    }
+    return -EINVAL;
+}
+
+static int trace_setting_parse(const char *name) {
+    for (int i = 0; i < LED_SETTINGS_COUNT; i++) {
+        if (strcmp(name, setting_info[i].name) == 0) return i;
+    }
+    return -EINVAL;
+}
+
+static bool trace_number_parse(const char *token, unsigned long *value) {
+    char *end;
+
+    *value = strtoul(token, &end, 0);
+    return end != token && *end == '\0';
+}
+
+// "<ms> [origin] <event> 0x<value> [<setting>]", false for any other line: the
+// entry count, a shell prompt
+static bool trace_line_parse(char *line, bool *origin, struct led_trace_entry *entry) {
+    char *tokens[5];
+    int count = 0;
+
+    for (char *cursor = line; count < (int)ARRAY_SIZE(tokens);) {
+        cursor += strspn(cursor, " \t\r");
+        if (*cursor == '\0') break;
+
+        tokens[count++] = cursor;
+        cursor += strcspn(cursor, " \t\r");
+        if (*cursor != '\0') *cursor++ = '\0';
+    }
+
+    unsigned long time_ms;
+    unsigned long value;
+    int pos = 1;
+    int arg = 0;
+
+    if (count < 3 || !trace_number_parse(tokens[0], &time_ms)) return false;
+    *origin = strcmp(tokens[1], "origin") == 0;
+    if (*origin) pos++;
+    if (count < pos + 2) return false;
+
+    int event = trace_event_parse(tokens[pos]);
+    if (event < 0 || !trace_number_parse(tokens[pos + 1], &value)) return false;
+    if (event == LED_TRACE_SETTING) {
+        if (count < pos + 3) return false;
+        arg = trace_setting_parse(tokens[pos + 2]);
+        if (arg < 0) return false;
+    }
+
+    *entry = (struct led_trace_entry){
+        .time_ms = time_ms,
+        .value = value,
+        .event = event,
+        .arg = arg,
+    };
+    return true;
+}
+
+int led_test_trace_load(const char *dump) {
+    static struct led_trace_entry entries[LED_TRACE_ENTRIES];
+    __typeof__(trace_origin) origin = {.settings = LED_SETTINGS_DEFAULTS};
+    size_t count = 0;
+    char line[80];
+
+    while (*dump) {
+        size_t len = strcspn(dump, "\n");
+        struct led_trace_entry entry;
+        bool is_origin;
+
+        snprintf(line, sizeof(line), "%.*s", (int)len, dump);
+        dump += len + (dump[len] == '\n');
+
+        if (!trace_line_parse(line, &is_origin, &entry)) continue;
+
+        if (!is_origin) {
+            if (count == ARRAY_SIZE(entries)) {
+                return -EINVAL;
+            }
+            entries[count++] = entry;
+        } else if (entry.event == LED_TRACE_SETTING) {
+            origin.time_ms = entry.time_ms;
+            origin.settings[entry.arg] = entry.value;
+        } else if (entry.event < NUM_LED_INPUTS) {
+            origin.time_ms = entry.time_ms;
+            origin.inputs[entry.event] = entry.value;
+        }
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&trace_lock);
+    if (trace_replaying) {
+        k_spin_unlock(&trace_lock, key);
+        return -EBUSY;
+    }
+    trace_origin = origin;
+    memcpy(trace_entries, entries, count * sizeof(entries[0]));
+    trace_head = count % LED_TRACE_ENTRIES;
+    trace_count = count;
+    k_spin_unlock(&trace_lock, key);
+    return count;
+}
+
+bool led_test_trace_replaying(void) {
+    return trace_replaying;
+}
+
+uint16_t led_test_setting_live(uint8_t setting) {
+    return atomic_get(&settings_snapshot[setting]);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Renderer internals for the host tests. Only read these while the renderer
+// sleeps: the test thread never runs alongside it on native_sim.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+
+// Bar roles, in the order of the role enum in zmk,visorbearer-led-bar.yaml
+#define LED_TEST_ROLE_CONNECTION 0
+#define LED_TEST_ROLE_BATTERY 1
+
+// Renderer counters, update times are host CPU time
+struct led_test_cost {
+    uint32_t frames;
+    uint32_t event_wakeups;
+    uint32_t timeout_wakeups;
+    uint64_t update_ns;
+    uint32_t update_ns_max;
+    uint32_t bursts;
+    uint32_t bytes;
+    uint32_t write_errors;
+};
+
+void led_test_cost_get(struct led_test_cost *cost);
+void led_test_cost_reset(void);
+
+struct led_test_segment {
+    uint8_t target_color[3];
+    uint8_t brightness;
+    uint8_t target_brightness;
+    bool animating;
+    bool breathing;
+};
+
+// Segment of the first bar with the role
+int led_test_segment_get(int role, int segment, struct led_test_segment *out);
+bool led_test_role_shown(int role);
+
+// Boot animation start, and when it ends on the role's bars, 0 once it has
+void led_test_boot_window(int role, int64_t *start, int64_t *until);
+
+uint8_t led_test_battery_level(void);
+bool led_test_charging(void);
+bool led_test_actively_charging(void);
+
+// What the renderer last wrote to the chip, starting at register
+// LED_TEST_IMAGE_FIRST_REG. -ENODATA until the whole image has been written once.
+#define LED_TEST_IMAGE_FIRST_REG 0x02
+
+int led_test_chip_image(const struct device *dev, const uint8_t **image, size_t *len);
+
+// Replace the input trace with the origin and entries of a "visorbearer led trace
+// dump". Returns the number of entries, -EINVAL if there were more than fit or
+// -EBUSY during a replay.
+int led_test_trace_load(const char *dump);
+bool led_test_trace_replaying(void);
+// Setting the renderer is given, the trace's own during a replay
+uint16_t led_test_setting_live(uint8_t setting);
@@ -0,0 +1,174 @@
+// LP5012 I2C target for the host tests. Keeps the register image that the
+// Zephyr driver and the renderer write and counts the bus traffic per frame.
+
+#define DT_DRV_COMPAT ti_lp5012
+
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/kernel.h>
+
+#include "lp50xx_emul.h"
+
+#define LP5012_DEVICE_CONFIG0 0x00
+#define LP5012_CHIP_EN BIT(6)
+#define LP5012_RESET 0x17
+#define LP5012_RESET_VALUE 0xFF
+
+struct lp50xx_emul_data {
+    uint8_t regs[LP50XX_EMUL_REGS];
+    uint8_t reg;   // auto-increment register pointer
+};
+
+static const uint8_t lp5012_reset_regs[LP50XX_EMUL_REGS] = {
+    [0x01] = 0x3C,                                  // DEVICE_CONFIG1
+    [0x03] = 0xFF,                                  // BANK_BRIGHTNESS
+    [0x07] = 0xFF, [0x08] = 0xFF, [0x09] = 0xFF, [0x0A] = 0xFF,  // LEDx_BRIGHTNESS
+};
+
+static struct {
+    struct lp50xx_emul_stats stats;
+    int64_t frame_ms;
+    uint32_t frame_transfers;
+    uint32_t frame_bytes;
+    lp50xx_emul_write_cb_t write_cb;
+    void *write_cb_data;
+} bus;
+
+static void lp50xx_emul_reset(struct lp50xx_emul_data *data) {
+    memcpy(data->regs, lp5012_reset_regs, sizeof(data->regs));
+    data->reg = 0;
+}
+
+static void bus_count(uint32_t bytes) {
+    int64_t now = k_uptime_get();
+
+    if (bus.stats.frames == 0 || now != bus.frame_ms) {
+        bus.stats.frames++;
+        bus.frame_ms = now;
+        bus.frame_transfers = 0;
+        bus.frame_bytes = 0;
+    }
+    bus.frame_transfers++;
+    bus.frame_bytes += bytes;
+
+    bus.stats.transfers++;
+    bus.stats.bytes += bytes;
+    bus.stats.frame_transfers_max = MAX(bus.stats.frame_transfers_max, bus.frame_transfers);
+    bus.stats.frame_bytes_max = MAX(bus.stats.frame_bytes_max, bus.frame_bytes);
+}
+
+static int lp50xx_emul_write(const struct emul *target, const uint8_t *buf, size_t len) {
+    struct lp50xx_emul_data *data = target->data;
+    uint8_t first = data->reg;
+
+    if (first + len > LP50XX_EMUL_REGS) {
+        return -EIO;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t reg = data->reg++;
+
+        if (reg == LP5012_RESET) {
+            if (buf[i] == LP5012_RESET_VALUE) {
+                lp50xx_emul_reset(data);
+            }
+            continue;
+        }
+        data->regs[reg] = buf[i];
+    }
+
+    if (bus.write_cb) {
+        bus.write_cb(target, first, buf, len, bus.write_cb_data);
+    }
+    return 0;
+}
+
+// The first byte written after a start or repeated start sets the register
+// pointer, every data byte read or written after it moves the pointer on
+static int lp50xx_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+                                int addr) {
+    struct lp50xx_emul_data *data = target->data;
+    bool addressed = false;
+    uint32_t written = 0;
+
+    for (int m = 0; m < num_msgs; m++) {
+        struct i2c_msg *msg = &msgs[m];
+
+        if (msg->flags & I2C_MSG_RESTART) {
+            addressed = false;
+        }
+
+        if ((msg->flags & I2C_MSG_RW_MASK) == I2C_MSG_READ) {
+            if (data->reg + msg->len > LP50XX_EMUL_REGS) {
+                return -EIO;
+            }
+            memcpy(msg->buf, &data->regs[data->reg], msg->len);
+            data->reg += msg->len;
+            continue;
+        }
+
+        const uint8_t *buf = msg->buf;
+        size_t len = msg->len;
+
+        if (!addressed && len > 0) {
+            data->reg = buf[0];
+            addressed = true;
+            buf++;
+            len--;
+        }
+        if (len > 0) {
+            int err = lp50xx_emul_write(target, buf, len);
+            if (err < 0) {
+                return err;
+            }
+            written += len;
+        }
+    }
+
+    bus_count(written);
+    return 0;
+}
+
+void lp50xx_emul_stats_get(struct lp50xx_emul_stats *stats) {
+    *stats = bus.stats;
+}
+
+void lp50xx_emul_stats_reset(void) {
+    memset(&bus.stats, 0, sizeof(bus.stats));
+}
+
+const uint8_t *lp50xx_emul_regs(const struct emul *target) {
+    const struct lp50xx_emul_data *data = target->data;
+
+    return data->regs;
+}
+
+bool lp50xx_emul_enabled(const struct emul *target) {
+    const struct lp50xx_emul_data *data = target->data;
+
+    return (data->regs[LP5012_DEVICE_CONFIG0] & LP5012_CHIP_EN) != 0;
+}
+
+void lp50xx_emul_set_write_cb(lp50xx_emul_write_cb_t cb, void *user_data) {
+    bus.write_cb = cb;
+    bus.write_cb_data = user_data;
+}
+
+static const struct i2c_emul_api lp50xx_emul_api = {
+    .transfer = lp50xx_emul_transfer,
+};
+
+static int lp50xx_emul_init(const struct emul *target, const struct device *parent) {
+    lp50xx_emul_reset(target->data);
+    return 0;
+}
+
+#define LP50XX_EMUL(n)                                                                       \
+    static struct lp50xx_emul_data lp50xx_emul_data_##n;                                     \
+    EMUL_DT_INST_DEFINE(n, lp50xx_emul_init, &lp50xx_emul_data_##n, NULL, &lp50xx_emul_api,  \
+                        NULL)
+
+DT_INST_FOREACH_STATUS_OKAY(LP50XX_EMUL)
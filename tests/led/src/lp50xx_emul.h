@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/drivers/emul.h>
+
+// LP5012 register map: DEVICE_CONFIG0 up to RESET
+#define LP50XX_EMUL_REGS 0x18
+
+// Bus traffic of every emulated LP50xx together. Transfers that happen in the
+// same millisecond of uptime count as one frame: frames are at least
+// LED_FRAME_MIN_MS apart and never sleep while writing.
+struct lp50xx_emul_stats {
+    uint32_t transfers;
+    uint32_t bytes;         // register bytes written, register addresses excluded
+    uint32_t frames;        // milliseconds with any traffic
+    uint32_t frame_transfers_max;
+    uint32_t frame_bytes_max;
+};
+
+void lp50xx_emul_stats_get(struct lp50xx_emul_stats *stats);
+void lp50xx_emul_stats_reset(void);
+
+// Current register image, indexed by register address
+const uint8_t *lp50xx_emul_regs(const struct emul *target);
+bool lp50xx_emul_enabled(const struct emul *target);
+
+// Called for every run of registers written in one burst, in bus order
+typedef void (*lp50xx_emul_write_cb_t)(const struct emul *target, uint8_t reg,
+                                       const uint8_t *values, size_t len, void *user_data);
+
+void lp50xx_emul_set_write_cb(lp50xx_emul_write_cb_t cb, void *user_data);
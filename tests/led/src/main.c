@@ -0,0 +1,198 @@
+// Drives the renderer with ZMK events on native_sim and reports what each
+// scenario costs: frames, wakeups, LP50xx bus traffic and update_bars() time.
+// Lines starting with "BENCH" carry the numbers for CI to compare runs.
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <zmk/hid.h>
+
+#include "led_under_test.h"
+#include "lp50xx_emul.h"
+#include "scenario.h"
+
+// Same as src/led.c
+#define LED_FRAME_MIN_MS 10
+
+#define LED_ANIM_FRAMES CONFIG_VISORBEARER_LED_BAR_FRAMES_PER_TRANSITION
+#define EVENT_DISPLAY_MS CONFIG_VISORBEARER_LED_BAR_EVENT_DISPLAY_TIME_MS
+
+// LED_CONFIG0 up to the last OUTx_COLOR of an LP5012
+#define LP5012_IMAGE_REGS 21
+
+#define STORM_EVENTS 200
+#define STORM_SPACING_MS 3
+
+static const struct device *const chips[] = {
+    DEVICE_DT_GET(DT_NODELABEL(lp5012a)),
+    DEVICE_DT_GET(DT_NODELABEL(lp5012b)),
+};
+
+static const struct emul *const chip_emuls[] = {
+    EMUL_DT_GET(DT_NODELABEL(lp5012a)),
+    EMUL_DT_GET(DT_NODELABEL(lp5012b)),
+};
+
+static const uint8_t color_white[3] = {0xFF, 0xFF, 0xFF};
+static const uint8_t color_background[3] = {0x08, 0x08, 0x08};
+static const uint8_t color_red[3] = {0xB3, 0x00, 0x00};
+static const uint8_t color_green[3] = {0x00, 0xB3, 0x00};
+
+// Every scenario ends dark and idle, and no frame rewrites more than both images
+static void cost_check(const struct scenario_cost *cost) {
+    zassert_equal(cost->led.write_errors, 0, "%u LP50xx writes failed", cost->led.write_errors);
+    zassert_true(cost->bus.frame_bytes_max <= ARRAY_SIZE(chips) * (LP5012_IMAGE_REGS + 1),
+                 "a frame wrote %u bytes", cost->bus.frame_bytes_max);
+    zassert_false(led_test_role_shown(LED_TEST_ROLE_CONNECTION), "connection bar still shown");
+    zassert_false(led_test_role_shown(LED_TEST_ROLE_BATTERY), "battery bar still shown");
+}
+
+static struct led_test_segment segment(int role, int index) {
+    struct led_test_segment seg = {0};
+
+    if (led_test_segment_get(role, index, &seg) < 0) {
+        ztest_test_fail();
+    }
+    return seg;
+}
+
+static void *led_setup(void) {
+    k_sleep(K_MSEC(BOOT_SETTLE_MS));
+    return NULL;
+}
+
+static void led_before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    scenario_baseline();
+    cost_reset();
+}
+
+ZTEST(led, test_idle_is_silent) {
+    struct scenario_cost cost;
+
+    k_sleep(K_SECONDS(60));
+
+    cost_get(&cost);
+    cost_report("idle", &cost);
+    zassert_equal(cost.led.frames, 0, "%u frames while idle", cost.led.frames);
+    zassert_equal(cost.led.event_wakeups + cost.led.timeout_wakeups, 0, "renderer woke up");
+    zassert_equal(cost.bus.transfers, 0, "%u I2C transfers while idle", cost.bus.transfers);
+}
+
+ZTEST(led, test_profile_change) {
+    struct scenario_cost cost;
+
+    raise_profile(1, true);
+    k_sleep(K_MSEC(500));
+
+    zassert_true(led_test_role_shown(LED_TEST_ROLE_CONNECTION));
+    zassert_mem_equal(segment(LED_TEST_ROLE_CONNECTION, 1).target_color, color_white, 3);
+    zassert_equal(segment(LED_TEST_ROLE_CONNECTION, 1).target_brightness, 100);
+    zassert_mem_equal(segment(LED_TEST_ROLE_CONNECTION, 0).target_color, color_background, 3);
+
+    k_sleep(K_MSEC(SETTLE_MS));
+
+    cost_get(&cost);
+    cost_report("profile-change", &cost);
+    cost_check(&cost);
+    // the profile and show inputs land in one frame
+    zassert_equal(cost.led.event_wakeups, 1, "%u event wakeups", cost.led.event_wakeups);
+    // a fade in and a fade out
+    zassert_true(cost.led.frames <= 3 * LED_ANIM_FRAMES, "%u frames", cost.led.frames);
+    zassert_true(cost.bus.bytes > 0);
+}
+
+ZTEST(led, test_battery_drop_to_critical) {
+    struct scenario_cost cost;
+
+    raise_battery(5);
+    k_sleep(K_MSEC(1000));
+
+    zassert_equal(led_test_battery_level(), 5);
+    zassert_true(led_test_role_shown(LED_TEST_ROLE_BATTERY), "critical battery not shown");
+    zassert_true(segment(LED_TEST_ROLE_BATTERY, 0).breathing);
+    zassert_mem_equal(segment(LED_TEST_ROLE_BATTERY, 0).target_color, color_red, 3);
+    zassert_false(segment(LED_TEST_ROLE_BATTERY, 1).breathing);
+
+    k_sleep(K_MSEC(SETTLE_MS));
+
+    cost_get(&cost);
+    cost_report("battery-critical", &cost);
+    cost_check(&cost);
+    zassert_equal(cost.led.event_wakeups, 1, "%u event wakeups", cost.led.event_wakeups);
+    // breathing is paced by its period, not the highest frame rate
+    zassert_true(cost.led.frames < EVENT_DISPLAY_MS / LED_FRAME_MIN_MS, "%u frames",
+                 cost.led.frames);
+}
+
+ZTEST(led, test_usb_plug_and_charge) {
+    struct scenario_cost cost;
+
+    raise_usb(true);
+    zassert_ok(set_charge_status(true));
+    k_sleep(K_MSEC(500));
+
+    zassert_true(led_test_charging());
+    zassert_true(led_test_actively_charging());
+    zassert_true(led_test_role_shown(LED_TEST_ROLE_BATTERY), "plugging USB shows the battery");
+    zassert_mem_equal(segment(LED_TEST_ROLE_BATTERY, 0).target_color, color_green, 3);
+    zassert_true(segment(LED_TEST_ROLE_BATTERY, 3).breathing, "segment being charged is static");
+
+    zassert_ok(set_charge_status(false));
+    k_sleep(K_MSEC(500));
+
+    zassert_true(led_test_charging());
+    zassert_false(led_test_actively_charging());
+    zassert_false(segment(LED_TEST_ROLE_BATTERY, 3).breathing, "charged segment still breathes");
+
+    k_sleep(K_MSEC(SETTLE_MS));
+
+    cost_get(&cost);
+    cost_report("usb-plug", &cost);
+    cost_check(&cost);
+}
+
+ZTEST(led, test_modifier_storm) {
+    struct scenario_cost cost;
+    int64_t start = k_uptime_get();
+
+    for (int i = 0; i < STORM_EVENTS; i++) {
+        raise_modifier(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT, i % 2 == 0);
+        k_sleep(K_MSEC(STORM_SPACING_MS));
+    }
+    int64_t storm_ms = k_uptime_get() - start;
+
+    k_sleep(K_MSEC(SETTLE_MS));
+
+    cost_get(&cost);
+    cost_report("modifier-storm", &cost);
+    cost_check(&cost);
+    zassert_equal(segment(LED_TEST_ROLE_CONNECTION, 0).target_brightness, 0,
+                  "shift segment lit after the last release");
+    // frame pacing holds the storm to the highest frame rate, then the last fade out
+    zassert_true(cost.led.frames <= storm_ms / LED_FRAME_MIN_MS + LED_ANIM_FRAMES,
+                 "%u frames for %lld ms of events", cost.led.frames, (long long)storm_ms);
+    zassert_true(cost.led.event_wakeups <= storm_ms / LED_FRAME_MIN_MS + 1, "%u event wakeups",
+                 cost.led.event_wakeups);
+}
+
+ZTEST(led, test_registers_match_shadow) {
+    // a paired but disconnected profile breathes, the chip is written every frame
+    raise_profile(2, false);
+    k_sleep(K_MSEC(300));
+
+    for (size_t c = 0; c < ARRAY_SIZE(chips); c++) {
+        const uint8_t *image;
+        size_t len;
+
+        zassert_ok(led_test_chip_image(chips[c], &image, &len));
+        zassert_mem_equal(&lp50xx_emul_regs(chip_emuls[c])[LED_TEST_IMAGE_FIRST_REG], image, len,
+                          "%s registers differ from the renderer's shadow", chips[c]->name);
+    }
+    zassert_true(lp50xx_emul_enabled(chip_emuls[0]), "lit chip is powered down");
+}
+
+ZTEST_SUITE(led, NULL, led_setup, led_before, NULL, NULL);
@@ -0,0 +1,235 @@
+// Replays renderer input traces on the emulated chips in virtual time and prints the
+// register writes they cause, frame by frame. The trace is the output of "visorbearer
+// led trace dump" on a keyboard, LED_TRACE_FILE picks it at build time.
+
+#include <string.h>
+
+#include <zephyr/drivers/emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/shell/shell_dummy.h>
+#include <zephyr/ztest.h>
+
+#include <visorbearer-zmk-module/led_settings.h>
+#include <zmk/hid.h>
+
+#include "led_under_test.h"
+#include "lp50xx_emul.h"
+#include "scenario.h"
+
+#define BUS_LOG_WRITES 4096
+#define REPLAY_POLL_MS 100
+
+// bench_session.txt turns the brightness down to 50 this long after its origin
+#define TRACE_FILE_DIMMED_MS 2500
+#define TRACE_FILE_BRIGHTNESS 50
+
+static const char trace_file[] = {
+#include "led_trace.inc"
+    0,
+};
+
+struct bus_write {
+    uint32_t time_ms;   // since the trace origin
+    const struct emul *chip;
+    uint8_t reg;
+    uint8_t len;
+    uint8_t values[LP50XX_EMUL_REGS];
+};
+
+struct bus_log {
+    int64_t origin;
+    size_t count;
+    bool overflow;
+    struct bus_write writes[BUS_LOG_WRITES];
+};
+
+static struct bus_log recorded_log;
+static struct bus_log replayed_log;
+
+static void bus_log_write(const struct emul *target, uint8_t reg, const uint8_t *values,
+                          size_t len, void *user_data) {
+    struct bus_log *log = user_data;
+
+    if (log->count == ARRAY_SIZE(log->writes)) {
+        log->overflow = true;
+        return;
+    }
+
+    struct bus_write *write = &log->writes[log->count++];
+    write->time_ms = k_uptime_get() - log->origin;
+    write->chip = target;
+    write->reg = reg;
+    write->len = MIN(len, sizeof(write->values));
+    memcpy(write->values, values, write->len);
+}
+
+static void bus_log_start(struct bus_log *log) {
+    log->origin = k_uptime_get();
+    log->count = 0;
+    log->overflow = false;
+    lp50xx_emul_set_write_cb(bus_log_write, log);
+}
+
+static void bus_log_stop(void) {
+    lp50xx_emul_set_write_cb(NULL, NULL);
+}
+
+// One line per burst, writes in the same millisecond belong to one frame
+static void bus_log_print(const struct bus_log *log) {
+    for (size_t i = 0; i < log->count; i++) {
+        const struct bus_write *write = &log->writes[i];
+        char hex[3 * LP50XX_EMUL_REGS + 1];
+
+        for (int b = 0; b < write->len; b++) {
+            snprintf(&hex[3 * b], sizeof(hex) - 3 * b, " %02x", write->values[b]);
+        }
+        TC_PRINT("I2C %6u ms %s 0x%02x:%s\n", write->time_ms, write->chip->dev->name,
+                 write->reg, write->len ? hex : "");
+    }
+}
+
+static bool bus_write_equal(const struct bus_write *a, const struct bus_write *b) {
+    return a->time_ms == b->time_ms && a->chip == b->chip && a->reg == b->reg &&
+           a->len == b->len && memcmp(a->values, b->values, a->len) == 0;
+}
+
+static void bus_log_check_equal(const struct bus_log *expected, const struct bus_log *actual) {
+    zassert_false(expected->overflow || actual->overflow, "more than %d writes",
+                  BUS_LOG_WRITES);
+
+    for (size_t i = 0; i < MIN(expected->count, actual->count); i++) {
+        const struct bus_write *e = &expected->writes[i];
+        const struct bus_write *a = &actual->writes[i];
+
+        zassert_true(bus_write_equal(e, a),
+                     "write %u: %s 0x%02x at %u ms expected, %s 0x%02x at %u ms replayed",
+                     (uint32_t)i, e->chip->dev->name, e->reg, e->time_ms, a->chip->dev->name,
+                     a->reg, a->time_ms);
+    }
+    zassert_equal(expected->count, actual->count, "%u writes expected, %u replayed",
+                  (uint32_t)expected->count, (uint32_t)actual->count);
+}
+
+// Output of a shell command, valid until the next one
+static void shell_run(const char *cmd, const char **output) {
+    const struct shell *sh = shell_backend_dummy_get_ptr();
+    size_t size;
+
+    shell_backend_dummy_clear_output(sh);
+    zassert_ok(shell_execute_cmd(sh, cmd), "\"%s\" failed", cmd);
+    if (output) {
+        *output = shell_backend_dummy_get_output(sh, &size);
+    }
+}
+
+static void replay_wait(void) {
+    while (led_test_trace_replaying()) {
+        k_sleep(K_MSEC(REPLAY_POLL_MS));
+    }
+}
+
+// Replay the loaded trace, then wait for the bars to settle after its last input
+static void replay_run(struct bus_log *log) {
+    bus_log_start(log);
+    shell_run("visorbearer led trace replay", NULL);
+    replay_wait();
+    k_sleep(K_MSEC(SETTLE_MS));
+    bus_log_stop();
+}
+
+static void *replay_setup(void) {
+    k_sleep(K_MSEC(BOOT_SETTLE_MS));
+    return NULL;
+}
+
+static void replay_before(void *fixture) {
+    ARG_UNUSED(fixture);
+
+    scenario_baseline();
+}
+
+// The same trace drives the same frames, down to every byte on the bus
+ZTEST(led_replay, test_trace_file) {
+    int entries = led_test_trace_load(trace_file);
+
+    zassert_true(entries > 0, "no entries in the trace file (%d)", entries);
+
+    replay_run(&recorded_log);
+    // whatever the first replay left on the bars, the origin puts back
+    scenario_baseline();
+    replay_run(&replayed_log);
+
+    TC_PRINT("Replayed %d entries: %u register writes\n", entries, (uint32_t)recorded_log.count);
+    bus_log_print(&recorded_log);
+    zassert_true(recorded_log.count > 0);
+    bus_log_check_equal(&recorded_log, &replayed_log);
+}
+
+// A trace taken on the device replays to the frames it recorded
+ZTEST(led_replay, test_record_and_replay) {
+    const char *dump;
+
+    bus_log_start(&recorded_log);
+    shell_run("visorbearer led trace clear", NULL);
+
+    raise_profile(1, true);
+    k_sleep(K_MSEC(450));
+    raise_modifier(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT, true);
+    k_sleep(K_MSEC(60));
+    raise_modifier(HID_USAGE_KEY_KEYBOARD_LEFTCONTROL, true);
+    k_sleep(K_MSEC(15));
+    raise_modifier(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT, false);
+    k_sleep(K_MSEC(80));
+    raise_modifier(HID_USAGE_KEY_KEYBOARD_LEFTCONTROL, false);
+    k_sleep(K_MSEC(300));
+    shell_run("visorbearer led set brightness 40", NULL);
+    raise_usb(true);
+    zassert_ok(set_charge_status(true));
+    k_sleep(K_MSEC(1200));
+    // back where it started, the replay puts the settings back only when they differ
+    shell_run("visorbearer led set brightness " STRINGIFY(CONFIG_VISORBEARER_LED_BAR_BRIGHTNESS),
+              NULL);
+    zassert_ok(set_charge_status(false));
+    k_sleep(K_MSEC(600));
+    raise_battery(6);
+    k_sleep(K_MSEC(SETTLE_MS));
+
+    bus_log_stop();
+    shell_run("visorbearer led trace dump", &dump);
+    zassert_true(led_test_trace_load(dump) > 0, "dump did not read back:\n%s", dump);
+
+    raise_usb(false);
+    k_sleep(K_MSEC(SETTLE_MS));
+    replay_run(&replayed_log);
+
+    TC_PRINT("Recorded %u register writes, replayed %u\n", (uint32_t)recorded_log.count,
+             (uint32_t)replayed_log.count);
+    zassert_true(recorded_log.count > 0);
+    bus_log_check_equal(&recorded_log, &replayed_log);
+}
+
+// The trace drives the bars, the user's settings stay the user's: a change made
+// during the replay is read back and saved right away and shows once it ends
+ZTEST(led_replay, test_setting_change_during_replay) {
+    const int brightness = CONFIG_VISORBEARER_LED_BAR_BRIGHTNESS - 10;
+
+    zassert_true(led_test_trace_load(trace_file) > 0);
+    shell_run("visorbearer led trace replay", NULL);
+    k_sleep(K_MSEC(TRACE_FILE_DIMMED_MS));
+    zassert_equal(led_test_setting_live(LED_SETTING_BRIGHTNESS), TRACE_FILE_BRIGHTNESS);
+    zassert_equal(led_setting_get(LED_SETTING_BRIGHTNESS), CONFIG_VISORBEARER_LED_BAR_BRIGHTNESS,
+                  "the trace's brightness leaked into the user's");
+
+    zassert_equal(led_setting_set(LED_SETTING_BRIGHTNESS, brightness), brightness);
+    zassert_equal(led_setting_get(LED_SETTING_BRIGHTNESS), brightness);
+    zassert_equal(led_test_setting_live(LED_SETTING_BRIGHTNESS), TRACE_FILE_BRIGHTNESS,
+                  "a change made during the replay showed before it ended");
+
+    replay_wait();
+    zassert_equal(led_test_setting_live(LED_SETTING_BRIGHTNESS), brightness);
+
+    led_setting_set(LED_SETTING_BRIGHTNESS, CONFIG_VISORBEARER_LED_BAR_BRIGHTNESS);
+}
+
+ZTEST_SUITE(led_replay, NULL, replay_setup, replay_before, NULL, NULL);
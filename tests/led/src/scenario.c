@@ -0,0 +1,89 @@
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <zmk/events/battery_state_changed.h>
+#include <zmk/events/ble_active_profile_changed.h>
+#include <zmk/events/keycode_state_changed.h>
+#include <zmk/events/usb_conn_state_changed.h>
+
+#include "scenario.h"
+#include "zmk_fakes.h"
+
+// Same as src/led.c
+#define CHARGE_STATUS_PIN 17
+
+static const struct device *const gpio0 = DEVICE_DT_GET(DT_NODELABEL(gpio0));
+
+void raise_profile(int index, bool connected) {
+    zmk_ble_active_profile_index_fake.return_val = index;
+    zmk_ble_active_profile_is_connected_fake.return_val = connected;
+    raise_zmk_ble_active_profile_changed((struct zmk_ble_active_profile_changed){.index = index});
+}
+
+void raise_battery(uint8_t state_of_charge) {
+    zmk_battery_state_of_charge_fake.return_val = state_of_charge;
+    raise_zmk_battery_state_changed(
+        (struct zmk_battery_state_changed){.state_of_charge = state_of_charge});
+}
+
+void raise_usb(bool powered) {
+    zmk_usb_is_powered_fake.return_val = powered;
+    raise_zmk_usb_conn_state_changed((struct zmk_usb_conn_state_changed){
+        .conn_state = powered ? ZMK_USB_CONN_POWERED : ZMK_USB_CONN_NONE,
+    });
+}
+
+void raise_modifier(uint32_t keycode, bool pressed) {
+    raise_zmk_keycode_state_changed((struct zmk_keycode_state_changed){
+        .usage_page = HID_USAGE_KEY,
+        .keycode = keycode,
+        .state = pressed,
+        .timestamp = k_uptime_get(),
+    });
+}
+
+// The charger pulls its status output low while charging
+int set_charge_status(bool charging) {
+    return gpio_emul_input_set(gpio0, CHARGE_STATUS_PIN, charging ? 0 : 1);
+}
+
+void scenario_baseline(void) {
+    ZMK_FAKES_LIST(RESET_FAKE);
+    FFF_RESET_HISTORY();
+    zmk_endpoints_selected_fake.return_val =
+        (struct zmk_endpoint_instance){.transport = ZMK_TRANSPORT_BLE};
+
+    raise_usb(false);
+    raise_profile(0, true);
+    raise_battery(BATTERY_BASELINE);
+    for (uint32_t keycode = HID_USAGE_KEY_KEYBOARD_LEFTCONTROL;
+         keycode <= HID_USAGE_KEY_KEYBOARD_RIGHT_GUI; keycode++) {
+        raise_modifier(keycode, false);
+    }
+
+    k_sleep(K_MSEC(SETTLE_MS));
+}
+
+void cost_reset(void) {
+    led_test_cost_reset();
+    lp50xx_emul_stats_reset();
+}
+
+void cost_get(struct scenario_cost *cost) {
+    led_test_cost_get(&cost->led);
+    lp50xx_emul_stats_get(&cost->bus);
+}
+
+void cost_report(const char *scenario, const struct scenario_cost *cost) {
+    uint32_t frames = MAX(cost->led.frames, 1);
+
+    TC_PRINT("BENCH %s frames=%u event_wakeups=%u timeout_wakeups=%u i2c_transfers=%u "
+             "i2c_bytes=%u i2c_transfers_per_frame_max=%u i2c_bytes_per_frame_max=%u "
+             "update_ns_avg=%u update_ns_max=%u\n",
+             scenario, cost->led.frames, cost->led.event_wakeups, cost->led.timeout_wakeups,
+             cost->bus.transfers, cost->bus.bytes, cost->bus.frame_transfers_max,
+             cost->bus.frame_bytes_max, (uint32_t)(cost->led.update_ns / frames),
+             cost->led.update_ns_max);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// ZMK events the tests drive the renderer with, the state each test starts from and
+// what a scenario costs
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "led_under_test.h"
+#include "lp50xx_emul.h"
+
+// Boot animation and startup display are over by then
+#define BOOT_SETTLE_MS 10000
+// A status shown now has expired and faded out by then
+#define SETTLE_MS (CONFIG_VISORBEARER_LED_BAR_EVENT_DISPLAY_TIME_MS + 1000)
+
+#define BATTERY_BASELINE 80
+
+void raise_profile(int index, bool connected);
+void raise_battery(uint8_t state_of_charge);
+void raise_usb(bool powered);
+void raise_modifier(uint32_t keycode, bool pressed);
+int set_charge_status(bool charging);
+
+// Profile 0 connected, on battery at BATTERY_BASELINE, no modifiers held, and every
+// status shown on the way there faded out again
+void scenario_baseline(void);
+
+// What a scenario cost the renderer and the bus since the last cost_reset()
+struct scenario_cost {
+    struct led_test_cost led;
+    struct lp50xx_emul_stats bus;
+};
+
+void cost_reset(void);
+void cost_get(struct scenario_cost *cost);
+// Print the "BENCH <scenario>" line CI compares between runs
+void cost_report(const char *scenario, const struct scenario_cost *cost);
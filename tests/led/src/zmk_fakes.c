@@ -0,0 +1,48 @@
+#include <zephyr/kernel.h>
+
+#include <zmk/event_manager.h>
+#include <zmk/events/activity_state_changed.h>
+#include <zmk/events/battery_state_changed.h>
+#include <zmk/events/ble_active_profile_changed.h>
+#include <zmk/events/hid_indicators_changed.h>
+#include <zmk/events/keycode_state_changed.h>
+#include <zmk/events/layer_state_changed.h>
+#include <zmk/events/usb_conn_state_changed.h>
+
+#include "zmk_fakes.h"
+
+DEFINE_FFF_GLOBALS;
+
+DEFINE_FAKE_VALUE_FUNC(int, zmk_ble_active_profile_index);
+DEFINE_FAKE_VALUE_FUNC(bool, zmk_ble_active_profile_is_connected);
+DEFINE_FAKE_VALUE_FUNC(bool, zmk_ble_active_profile_is_open);
+DEFINE_FAKE_VALUE_FUNC(uint8_t, zmk_battery_state_of_charge);
+DEFINE_FAKE_VALUE_FUNC(bool, zmk_usb_is_powered);
+DEFINE_FAKE_VALUE_FUNC(zmk_mod_flags_t, zmk_hid_get_explicit_mods);
+DEFINE_FAKE_VALUE_FUNC(struct zmk_endpoint_instance, zmk_endpoints_selected);
+DEFINE_FAKE_VALUE_FUNC(zmk_keymap_layer_id_t, zmk_keymap_highest_layer_active);
+DEFINE_FAKE_VALUE_FUNC(zmk_keymap_layer_id_t, zmk_keymap_layer_default);
+DEFINE_FAKE_VALUE_FUNC(zmk_hid_indicators_t, zmk_hid_indicators_get_current_profile);
+
+ZMK_EVENT_IMPL(zmk_activity_state_changed);
+ZMK_EVENT_IMPL(zmk_battery_state_changed);
+ZMK_EVENT_IMPL(zmk_ble_active_profile_changed);
+ZMK_EVENT_IMPL(zmk_hid_indicators_changed);
+ZMK_EVENT_IMPL(zmk_keycode_state_changed);
+ZMK_EVENT_IMPL(zmk_layer_state_changed);
+ZMK_EVENT_IMPL(zmk_usb_conn_state_changed);
+
+int zmk_event_manager_raise(zmk_event_t *event) {
+    STRUCT_SECTION_FOREACH(zmk_event_subscription, sub) {
+        if (sub->event_type != event->event) continue;
+
+        int ret = sub->listener->callback(event);
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret != ZMK_EV_EVENT_BUBBLE) {
+            break;
+        }
+    }
+    return 0;
+}
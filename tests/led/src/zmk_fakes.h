@@ -0,0 +1,36 @@
+#pragma once
+
+// ZMK state the LED renderer reads back, set by the tests through FFF
+
+#include <zephyr/fff.h>
+
+#include <zmk/ble.h>
+#include <zmk/battery.h>
+#include <zmk/endpoints.h>
+#include <zmk/hid.h>
+#include <zmk/hid_indicators.h>
+#include <zmk/keymap.h>
+#include <zmk/usb.h>
+
+DECLARE_FAKE_VALUE_FUNC(int, zmk_ble_active_profile_index);
+DECLARE_FAKE_VALUE_FUNC(bool, zmk_ble_active_profile_is_connected);
+DECLARE_FAKE_VALUE_FUNC(bool, zmk_ble_active_profile_is_open);
+DECLARE_FAKE_VALUE_FUNC(uint8_t, zmk_battery_state_of_charge);
+DECLARE_FAKE_VALUE_FUNC(bool, zmk_usb_is_powered);
+DECLARE_FAKE_VALUE_FUNC(zmk_mod_flags_t, zmk_hid_get_explicit_mods);
+DECLARE_FAKE_VALUE_FUNC(struct zmk_endpoint_instance, zmk_endpoints_selected);
+DECLARE_FAKE_VALUE_FUNC(zmk_keymap_layer_id_t, zmk_keymap_highest_layer_active);
+DECLARE_FAKE_VALUE_FUNC(zmk_keymap_layer_id_t, zmk_keymap_layer_default);
+DECLARE_FAKE_VALUE_FUNC(zmk_hid_indicators_t, zmk_hid_indicators_get_current_profile);
+
+#define ZMK_FAKES_LIST(FAKE)                                                                 \
+    FAKE(zmk_ble_active_profile_index)                                                       \
+    FAKE(zmk_ble_active_profile_is_connected)                                                \
+    FAKE(zmk_ble_active_profile_is_open)                                                     \
+    FAKE(zmk_battery_state_of_charge)                                                        \
+    FAKE(zmk_usb_is_powered)                                                                 \
+    FAKE(zmk_hid_get_explicit_mods)                                                          \
+    FAKE(zmk_endpoints_selected)                                                             \
+    FAKE(zmk_keymap_highest_layer_active)                                                    \
+    FAKE(zmk_keymap_layer_default)                                                           \
+    FAKE(zmk_hid_indicators_get_current_profile)